@@ -0,0 +1,417 @@
+#include "cellsession.h"
+#include <QDebug>
+#include <limits>
+#include "device/fastvideothread.h"
+#include "device/streamrecorder.h"
+#include "displayclock.h"
+#include "thumbnailcache.h"
+
+// how often a running stream refreshes its cached thumbnail
+static const qint64 thumbnailInterval = 30000;
+
+CellSession::CellSession(QObject *parent)
+    : QObject(parent)
+{
+    connect(DisplayClock::instance(), &DisplayClock::tick, this, &CellSession::onDisplayTick);
+    QosManager::instance()->addSession(this);
+}
+
+CellSession::~CellSession()
+{
+    QosManager::instance()->removeSession(this);
+    stop();
+}
+
+void CellSession::setConf(const CellWidgetConf &conf)
+{
+    m_conf = conf;
+}
+
+const CellWidgetConf &CellSession::conf() const
+{
+    return m_conf;
+}
+
+void CellSession::setDevice(const AdbServer &server, const QString &deviceId)
+{
+    if (m_server == server && m_deviceId == deviceId) {
+        return;
+    }
+    m_server = server;
+    m_deviceId = deviceId;
+    emit deviceChanged(m_deviceId);
+    if (m_image.isNull()) {
+        loadThumbnail();
+    }
+}
+
+AdbServer CellSession::server() const
+{
+    return m_server;
+}
+
+QString CellSession::deviceId() const
+{
+    return m_deviceId;
+}
+
+StreamHub::Source CellSession::source() const
+{
+    StreamHub::Source source;
+    source.host = m_server.host;
+    source.port = m_server.port;
+    source.deviceId = m_deviceId;
+    source.backend = m_conf.backend;
+    return source;
+}
+
+void CellSession::start()
+{
+    if (m_deviceId.isEmpty() || m_sink) {
+        return;
+    }
+
+    m_sink = StreamHub::instance()->subscribe(source());
+
+    m_sink->setVisibility(m_visibility);
+    applyTier();
+
+    VideoThread *videoThread = m_sink->videoThread();
+    videoThread->setScaleFilter(VideoThread::ScaleFilter(m_conf.scaleFilter));
+    if (auto thread = fastThread()) {
+        thread->setReplayDuration(m_conf.replaySeconds);
+    }
+
+    connect(m_sink, &VideoSink::imageReady, this, &CellSession::onImageReady);
+    connect(m_sink, &VideoSink::statsReady, this, &CellSession::onStatsReady);
+    connect(m_sink, &VideoSink::frameSizeChanged, this, &CellSession::onFrameSizeChanged);
+    updateRecording();
+    emit runningChanged(true);
+}
+
+void CellSession::stop()
+{
+    if (!m_sink) {
+        return;
+    }
+    // the last frame stays, views show it as stale
+    storeThumbnail();
+    StreamHub::instance()->unsubscribe(m_sink);
+    m_sink = nullptr;
+    m_pendingImage = QImage();
+    emit runningChanged(false);
+}
+
+bool CellSession::isRunning() const
+{
+    return m_sink;
+}
+
+bool CellSession::needsStream() const
+{
+    return m_sink && m_conf.isStream() && (m_recording || m_conf.replaySeconds > 0);
+}
+
+bool CellSession::isStale() const
+{
+    return !m_sink && !m_image.isNull();
+}
+
+QString CellSession::status() const
+{
+    if (m_sink) {
+        return tr("%1 fps").arg(m_stats.fps, 0, 'f', 1);
+    }
+    if (m_imageTimer.isValid()) {
+        return tr("paused, %1 s old").arg((m_imageAgeMs + m_imageTimer.elapsed()) / 1000);
+    }
+    return QString();
+}
+
+void CellSession::setDecodeMode(VideoThread::DecodeMode mode)
+{
+    m_decodeMode = mode;
+    applyTier();
+}
+
+VideoThread::DecodeMode CellSession::decodeMode() const
+{
+    return m_decodeMode;
+}
+
+void CellSession::setFocused(bool focused)
+{
+    if (m_focused == focused) {
+        return;
+    }
+    m_focused = focused;
+    // leaving a cell makes it a recent one
+    m_interactionTimer.start();
+    QosManager::instance()->update();
+}
+
+bool CellSession::isFocused() const
+{
+    return m_focused;
+}
+
+void CellSession::setDetailOpen(bool open)
+{
+    if (m_detailOpen == open) {
+        return;
+    }
+    m_detailOpen = open;
+    QosManager::instance()->update();
+}
+
+bool CellSession::isDetailOpen() const
+{
+    return m_detailOpen;
+}
+
+void CellSession::noteInteraction()
+{
+    m_interactionTimer.start();
+    QosManager::instance()->update();
+}
+
+qint64 CellSession::idleMs() const
+{
+    return m_interactionTimer.isValid() ? m_interactionTimer.elapsed()
+                                        : std::numeric_limits<qint64>::max();
+}
+
+void CellSession::setTier(QosManager::Tier tier)
+{
+    if (m_tier == tier) {
+        return;
+    }
+    m_tier = tier;
+    applyTier();
+}
+
+QosManager::Tier CellSession::tier() const
+{
+    return m_tier;
+}
+
+double CellSession::imageScale() const
+{
+    return m_imageScale;
+}
+
+QSize CellSession::fullImageSize(const QSize &frameSize) const
+{
+    return m_targetSize.isEmpty() ? frameSize * (m_conf.scale / 100.0)
+                                  : frameSize.scaled(m_targetSize, Qt::KeepAspectRatio);
+}
+
+double CellSession::scaleOf(const QImage &image) const
+{
+    // frames in flight when the tier changes were made for the previous one,
+    // so the scale is measured instead of taken from the current profile
+    const QSize full = fullImageSize(m_frameSize);
+    const int fullSide = qMax(full.width(), full.height());
+    if (image.isNull() || fullSide <= 0) {
+        return QosManager::instance()->profile(m_tier).scale;
+    }
+    // the longer sides, a frame from before a rotation compares the same
+    return qMax(image.width(), image.height()) / double(fullSide);
+}
+
+void CellSession::setTargetSize(const QSize &size)
+{
+    m_targetSize = size;
+    applyTier();
+}
+
+void CellSession::setVisibility(VideoSink::Visibility visibility)
+{
+    m_visibility = visibility;
+    if (m_sink) {
+        m_sink->setVisibility(visibility);
+    }
+}
+
+VideoSink::Visibility CellSession::visibility() const
+{
+    return m_visibility;
+}
+
+void CellSession::applyTier()
+{
+    if (!m_sink) {
+        return;
+    }
+    // pushed to the running stream, nothing restarts
+    const QosManager::Profile profile = QosManager::instance()->profile(m_tier);
+    m_sink->setImageScalePercent(m_conf.scale * profile.scale);
+    m_sink->setTargetSize(m_targetSize * profile.scale);
+    double rate = m_conf.rate;
+    if (profile.minRate > 0) {
+        rate = qMax(rate, profile.minRate);
+    }
+    if (profile.maxRate > 0) {
+        rate = qMin(rate, profile.maxRate);
+    }
+    m_sink->setImageRate(rate);
+    m_sink->setDecodeMode(qMax(m_decodeMode, profile.decodeMode));
+    m_sink->setWeight(profile.weight);
+}
+
+const QImage &CellSession::image() const
+{
+    return m_image;
+}
+
+const VideoStats &CellSession::stats() const
+{
+    return m_stats;
+}
+
+QSize CellSession::frameSize() const
+{
+    return m_frameSize;
+}
+
+int CellSession::rotation() const
+{
+    return m_rotation;
+}
+
+void CellSession::onImageReady(const QImage &image)
+{
+    // a frame not shown yet is replaced and goes back to its pool
+    m_pendingImage = image;
+    DisplayClock::instance()->frameArrived();
+}
+
+void CellSession::onDisplayTick()
+{
+    if (m_pendingImage.isNull()) {
+        return;
+    }
+    m_image = m_pendingImage;
+    m_pendingImage = QImage();
+    m_imageScale = scaleOf(m_image);
+    m_imageTimer.start();
+    m_imageAgeMs = 0;
+    if (!m_thumbnailTimer.isValid() || m_thumbnailTimer.elapsed() >= thumbnailInterval) {
+        storeThumbnail();
+    }
+    emit imageChanged();
+}
+
+void CellSession::loadThumbnail()
+{
+    QSize frameSize;
+    qint64 ageMs = 0;
+    QImage image = ThumbnailCache::instance()->load(thumbnailKey(), &frameSize, &ageMs);
+    if (image.isNull()) {
+        return;
+    }
+    // sized like the frames the stream will deliver, so views lay it out the same
+    QSize size = image.size();
+    if (!frameSize.isEmpty()) {
+        size = fullImageSize(frameSize);
+    }
+    size = size * QosManager::instance()->profile(m_tier).scale;
+    if (!size.isEmpty() && size != image.size()) {
+        image = image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    m_image = image;
+    m_frameSize = frameSize;
+    m_imageScale = scaleOf(m_image);
+    m_imageAgeMs = ageMs;
+    m_imageTimer.start();
+    emit imageChanged();
+}
+
+QString CellSession::thumbnailKey() const
+{
+    return m_server.name() + '/' + m_deviceId;
+}
+
+void CellSession::storeThumbnail()
+{
+    if (m_image.isNull() || m_imageAgeMs) {
+        return;
+    }
+    m_thumbnailTimer.start();
+    const QSize frameSize = m_frameSize.isEmpty() ? m_image.size() : m_frameSize;
+    ThumbnailCache::instance()->store(thumbnailKey(), m_image, frameSize);
+}
+
+void CellSession::onStatsReady(const VideoStats &stats)
+{
+    m_stats = stats;
+    emit statsChanged();
+}
+
+void CellSession::onFrameSizeChanged(const QSize &size, int rotation)
+{
+    m_frameSize = size;
+    m_rotation = rotation;
+    emit frameSizeChanged(size, rotation);
+}
+
+FastVideoThread *CellSession::fastThread() const
+{
+    return m_sink ? qobject_cast<FastVideoThread *>(m_sink->videoThread()) : nullptr;
+}
+
+void CellSession::setRecording(bool recording)
+{
+    m_recording = recording;
+    updateRecording();
+}
+
+QString CellSession::recordFile() const
+{
+    auto thread = fastThread();
+    return thread ? thread->recordFile() : QString();
+}
+
+void CellSession::updateRecording()
+{
+    auto thread = fastThread();
+    if (!thread) {
+        return;
+    }
+    connect(thread,
+            &FastVideoThread::recordFailed,
+            this,
+            &CellSession::onRecordFailed,
+            Qt::UniqueConnection);
+    if (!m_recording) {
+        thread->setRecordFile(QString());
+        return;
+    }
+    if (!thread->recordFile().isEmpty()) {
+        return;
+    }
+    thread->setRecordFile(StreamRecorder::defaultFileName(m_server.name(),
+                                                          m_deviceId,
+                                                          "rec",
+                                                          m_conf.recordFormat));
+}
+
+void CellSession::onRecordFailed(const QString &fileName)
+{
+    qWarning() << "WARNING: can't record" << m_deviceId << "to" << fileName;
+    m_recording = false;
+    emit recordFailed(fileName);
+}
+
+bool CellSession::saveReplay()
+{
+    auto thread = fastThread();
+    if (!thread || m_conf.replaySeconds <= 0) {
+        return false;
+    }
+    const QString fileName = StreamRecorder::defaultFileName(m_server.name(),
+                                                             m_deviceId,
+                                                             "replay",
+                                                             m_conf.recordFormat);
+    return thread->saveReplay(fileName, m_conf.replaySeconds);
+}
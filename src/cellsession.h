@@ -0,0 +1,140 @@
+#ifndef CELLSESSION_H
+#define CELLSESSION_H
+#include <QElapsedTimer>
+#include <QImage>
+#include <QObject>
+#include "device/devicetracker.h"
+#include "device/streamhub.h"
+#include "device/videosink.h"
+#include "qosmanager.h"
+class FastVideoThread;
+
+struct CellWidgetConf
+{
+    // devices of all of them share one grid
+    QList<AdbServer> servers{};
+    int rows{};
+    int cols{};
+    int scale{};
+    int rate{};
+    StreamHub::Backend backend{StreamHub::BackendScreencap};
+    bool fit{};
+    int scaleFilter{};
+    QString recordFormat{"mp4"};
+    int replaySeconds{};
+    bool surface{};
+
+    bool isStream() const { return backend != StreamHub::BackendScreencap; }
+};
+
+// What a grid cell shows, independent of how it is drawn: the device, the
+// subscription to its shared stream, the QoS tier it is in, and the latest
+// frame and stats.
+class CellSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CellSession(QObject *parent = nullptr);
+    ~CellSession();
+
+    void setConf(const CellWidgetConf &conf);
+    const CellWidgetConf &conf() const;
+    void setDevice(const AdbServer &server, const QString &deviceId);
+    AdbServer server() const;
+    QString deviceId() const;
+    StreamHub::Source source() const;
+
+    void start();
+    void stop();
+    bool isRunning() const;
+    // a recording or replay buffer that stopping the session would cut short
+    bool needsStream() const;
+    // a frame is shown but the stream is stopped, the frame may be outdated
+    bool isStale() const;
+    // short health line: the rate while streaming, the frame's age otherwise
+    QString status() const;
+
+    void setDecodeMode(VideoThread::DecodeMode mode);
+    VideoThread::DecodeMode decodeMode() const;
+    // what the QoS tier is chosen by
+    void setFocused(bool focused);
+    bool isFocused() const;
+    void setDetailOpen(bool open);
+    bool isDetailOpen() const;
+    void noteInteraction();
+    qint64 idleMs() const;
+
+    void setTier(QosManager::Tier tier);
+    QosManager::Tier tier() const;
+    // images come this much smaller than the cell shows them
+    double imageScale() const;
+    // fit frames into this size in device pixels, an empty size uses the scale
+    void setTargetSize(const QSize &size);
+    void setVisibility(VideoSink::Visibility visibility);
+    VideoSink::Visibility visibility() const;
+
+    const QImage &image() const;
+    const VideoStats &stats() const;
+    QSize frameSize() const;
+    int rotation() const;
+
+    FastVideoThread *fastThread() const;
+    void setRecording(bool recording);
+    QString recordFile() const;
+    bool saveReplay();
+
+signals:
+    void deviceChanged(const QString &deviceId);
+    void runningChanged(bool running);
+    void imageChanged();
+    void statsChanged();
+    void frameSizeChanged(const QSize &size, int rotation);
+    // recording is off again
+    void recordFailed(const QString &fileName);
+
+private slots:
+    void onImageReady(const QImage &image);
+    void onStatsReady(const VideoStats &stats);
+    void onFrameSizeChanged(const QSize &size, int rotation);
+    void onDisplayTick();
+    void onRecordFailed(const QString &fileName);
+
+private:
+    void applyTier();
+    // what a frame of the given size is shown as, before the tier's scale
+    QSize fullImageSize(const QSize &frameSize) const;
+    double scaleOf(const QImage &image) const;
+    void updateRecording();
+    void loadThumbnail();
+    void storeThumbnail();
+    QString thumbnailKey() const;
+
+    CellWidgetConf m_conf{};
+    AdbServer m_server{};
+    QString m_deviceId{};
+    VideoSink *m_sink{};
+    VideoThread::DecodeMode m_decodeMode{VideoThread::DecodeFull};
+    QosManager::Tier m_tier{QosManager::TierIdle};
+    bool m_focused{};
+    bool m_detailOpen{};
+    QElapsedTimer m_interactionTimer{};
+    bool m_recording{};
+    QSize m_targetSize{};
+    VideoSink::Visibility m_visibility{VideoSink::Visible};
+
+    QImage m_image{};
+    // m_image is this much smaller than the cell shows it
+    double m_imageScale{1.0};
+    // the newest frame, shown at the next display tick
+    QImage m_pendingImage{};
+    QElapsedTimer m_imageTimer{};
+    // a cached frame was this old when it was loaded
+    qint64 m_imageAgeMs{};
+    QElapsedTimer m_thumbnailTimer{};
+    VideoStats m_stats{};
+    QSize m_frameSize{};
+    int m_rotation{};
+};
+
+#endif // CELLSESSION_H
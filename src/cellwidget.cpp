@@ -1,114 +1,211 @@
 #include "cellwidget.h"
-#include <QHostAddress>
-#include <QLabel>
+#include <QEvent>
 #include <QLineEdit>
 #include <QPushButton>
 #include <QScrollArea>
+#include <QSignalBlocker>
 #include <QVBoxLayout>
-#include "device/adbclient.h"
-#include "device/fastvideothread.h"
-#include "device/videothread.h"
+#include "screenwidget.h"
 
-CellWidget::CellWidget(QWidget *parent)
+CellWidget::CellWidget(CellSession *session, QWidget *parent)
     : QWidget(parent)
+    , m_session(session)
 {
     m_mainLayout = new QVBoxLayout();
     m_toolLayout = new QHBoxLayout();
     m_area = new QScrollArea();
-    m_screen = new QLabel();
+    m_screen = new ScreenWidget();
     m_deviceInp = new QLineEdit();
-    m_aBtn = new QPushButton("A");
-    m_bBtn = new QPushButton("B");
-    m_cBtn = new QPushButton("C");
+    m_modeBtn = new QPushButton();
+    m_recordBtn = new QPushButton("R");
+    m_replayBtn = new QPushButton("S");
 
     const QSize btnSize{25, 25};
-    m_aBtn->setFixedSize(btnSize);
-    m_bBtn->setFixedSize(btnSize);
-    m_cBtn->setFixedSize(btnSize);
+    m_modeBtn->setFixedSize(btnSize);
+    m_recordBtn->setFixedSize(btnSize);
+    m_replayBtn->setFixedSize(btnSize);
 
-    connect(m_aBtn, &QPushButton::clicked, this, &CellWidget::onABtnClicked);
-    connect(m_bBtn, &QPushButton::clicked, this, &CellWidget::onBBtnClicked);
-    connect(m_cBtn, &QPushButton::clicked, this, &CellWidget::onCBtnClicked);
+    connect(m_modeBtn, &QPushButton::clicked, this, &CellWidget::onModeBtnClicked);
+    connect(m_recordBtn, &QPushButton::toggled, this, &CellWidget::onRecordBtnToggled);
+    connect(m_replayBtn, &QPushButton::clicked, this, &CellWidget::onReplayBtnClicked);
+
+    updateModeBtn();
+    m_recordBtn->setCheckable(true);
+    m_recordBtn->setToolTip(tr("Record the video stream without re-encoding"));
+
+    // only the H.264 stream can be remuxed
+    const CellWidgetConf &conf = m_session->conf();
+    m_recordBtn->setEnabled(conf.isStream());
+    m_replayBtn->setEnabled(conf.isStream() && conf.replaySeconds > 0);
+    m_replayBtn->setToolTip(tr("Save the last %1 seconds").arg(conf.replaySeconds));
 
     m_deviceInp->setReadOnly(true);
     m_deviceInp->setAlignment(Qt::AlignRight);
+    m_deviceInp->setText(m_session->deviceId());
     m_area->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     m_area->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     m_area->setWidget(m_screen);
+    m_area->setAlignment(Qt::AlignCenter);
+    m_area->viewport()->installEventFilter(this);
 
-    m_toolLayout->addWidget(m_aBtn);
-    m_toolLayout->addWidget(m_bBtn);
-    m_toolLayout->addWidget(m_cBtn);
+    m_toolLayout->addWidget(m_modeBtn);
+    m_toolLayout->addWidget(m_recordBtn);
+    m_toolLayout->addWidget(m_replayBtn);
     m_toolLayout->addWidget(m_deviceInp);
 
     m_mainLayout->addLayout(m_toolLayout);
     m_mainLayout->addWidget(m_area);
 
     setLayout(m_mainLayout);
+
+    connect(m_session, &CellSession::deviceChanged, m_deviceInp, &QLineEdit::setText);
+    connect(m_session, &CellSession::imageChanged, this, &CellWidget::updateScreen);
+    connect(m_session, &CellSession::statsChanged, this, &CellWidget::updateStats);
+    connect(m_session, &CellSession::frameSizeChanged, this, &CellWidget::updateFrameSize);
+    connect(m_session, &CellSession::recordFailed, this, [this](const QString &fileName) {
+        const QSignalBlocker blocker(m_recordBtn);
+        m_recordBtn->setChecked(false);
+        m_recordBtn->setToolTip(tr("Can't record to %1").arg(fileName));
+    });
+    connect(m_session, &CellSession::runningChanged, this, [this]() {
+        m_screen->setStale(m_session->isStale());
+        updateToolTip();
+    });
 }
 
-CellWidget::~CellWidget()
+CellWidget::~CellWidget() {}
+
+CellSession *CellWidget::session() const
 {
-    stop();
+    return m_session;
 }
 
-void CellWidget::setDevice(const QString &deviceId)
+void CellWidget::updateScreen()
 {
-    m_deviceInp->setText(deviceId);
-    //m_deviceInp->setText(deviceId.split(":").first());
+    // frames to fit come in device pixels of the viewport, lower tiers send them smaller
+    const qreal ratio = m_session->conf().fit ? devicePixelRatioF() : 1.0;
+    m_screen->setImage(m_session->image(), ratio * m_session->imageScale());
+    m_screen->setStale(m_session->isStale());
 }
 
-void CellWidget::setConf(const CellWidgetConf &conf)
+void CellWidget::updateTargetSize()
 {
-    m_conf = conf;
+    if (!m_session->conf().fit) {
+        m_session->setTargetSize(QSize());
+        return;
+    }
+    m_session->setTargetSize(m_area->viewport()->size() * devicePixelRatioF());
 }
 
-void CellWidget::start()
+bool CellWidget::eventFilter(QObject *watched, QEvent *event)
 {
-    const auto s{m_deviceInp->text()};
-    if (s.isEmpty()) {
-        return;
+    if (watched == m_area->viewport() && event->type() == QEvent::Resize) {
+        updateTargetSize();
+    }
+    if (watched == m_area->viewport() && event->type() == QEvent::MouseButtonPress) {
+        m_session->noteInteraction();
     }
+    return QWidget::eventFilter(watched, event);
+}
+
+void CellWidget::updateStats()
+{
+    updateToolTip();
+}
 
-    if (m_conf.fast) {
-        auto videoThread = new FastVideoThread();
-        m_videoThread = videoThread;
-    } else {
-        auto videoThread = new VideoThread();
-        videoThread->setImageFormat(VideoThread::ImagePng);
-        m_videoThread = videoThread;
+void CellWidget::updateToolTip()
+{
+    // stats of a stopped stream are old, show how old the image is instead
+    if (!m_session->isRunning()) {
+        m_screen->setToolTip(m_session->status());
+        return;
+    }
+    const VideoStats &stats = m_session->stats();
+    QString toolTip = tr("%1 fps, decode %2 ms, queue %3, dropped %4 packets")
+                          .arg(stats.fps, 0, 'f', 1)
+                          .arg(stats.decodeMs, 0, 'f', 1)
+                          .arg(stats.queueDepth)
+                          .arg(stats.droppedPackets);
+    if (stats.bitRateKbps) {
+        toolTip.append(
+            tr(", %1 of %2 kbps").arg(stats.ingressKbps, 0, 'f', 0).arg(stats.bitRateKbps));
+    }
+    if (stats.latencyMs >= 0) {
+        toolTip.append(tr(", latency +%1 ms").arg(stats.latencyMs, 0, 'f', 1));
     }
+    if (!stats.scaler.isEmpty()) {
+        toolTip.append(tr(", %1 scaler").arg(stats.scaler));
+    }
+    m_screen->setToolTip(toolTip);
+}
 
-    m_videoThread->setDevice(m_deviceInp->text());
-    m_videoThread->setImageScalePercent(m_conf.scale);
-    m_videoThread->setImageRate(m_conf.rate);
+void CellWidget::updateFrameSize(const QSize &size, int rotation)
+{
+    // the screen widget takes the new aspect ratio from the next frame itself
+    // the degree sign stays out of the translated string, sources aren't read as UTF-8 everywhere
+    m_deviceInp->setToolTip(tr("%1x%2, rotated %3%4")
+                                .arg(size.width())
+                                .arg(size.height())
+                                .arg(rotation)
+                                .arg(QChar(0x00B0)));
+}
 
-    connect(m_videoThread, &VideoThread::imageReady, this, &CellWidget::updateScreen);
-    connect(m_videoThread, &VideoThread::finished, this, &CellWidget::onVideoFinished);
-    connect(m_videoThread, &VideoThread::finished, m_videoThread, &VideoThread::deleteLater);
-    m_videoThread->start();
+void CellWidget::enterEvent(QEvent *event)
+{
+    m_session->setFocused(true);
+    QWidget::enterEvent(event);
 }
 
-void CellWidget::stop()
+void CellWidget::leaveEvent(QEvent *event)
 {
-    if (m_videoThread) {
-        m_videoThread->requestInterruption();
-    }
+    m_session->setFocused(false);
+    QWidget::leaveEvent(event);
 }
 
-void CellWidget::updateScreen(const QImage &image)
+void CellWidget::mouseDoubleClickEvent(QMouseEvent *event)
 {
-    m_screen->setPixmap(QPixmap::fromImage(image));
-    m_screen->setFixedSize(image.size());
+    if (m_session->isRunning()) {
+        emit detailRequested(m_session);
+        return;
+    }
+    QWidget::mouseDoubleClickEvent(event);
 }
 
-void CellWidget::onVideoFinished()
+void CellWidget::onModeBtnClicked()
 {
-    m_videoThread = {};
+    m_session->noteInteraction();
+    m_session->setDecodeMode(
+        VideoThread::DecodeMode((m_session->decodeMode() + 1) % (VideoThread::DecodeKeyframes + 1)));
+    updateModeBtn();
 }
 
-void CellWidget::onABtnClicked() {}
+void CellWidget::updateModeBtn()
+{
+    switch (m_session->decodeMode()) {
+    case VideoThread::DecodeThumbnail:
+        m_modeBtn->setText("T");
+        m_modeBtn->setToolTip(tr("Thumbnail: decode all frames, show them at image rate"));
+        break;
+    case VideoThread::DecodeKeyframes:
+        m_modeBtn->setText("K");
+        m_modeBtn->setToolTip(tr("Keyframes: decode and show keyframes only"));
+        break;
+    default:
+        m_modeBtn->setText("F");
+        m_modeBtn->setToolTip(tr("Full: decode and show every frame"));
+        break;
+    }
+}
 
-void CellWidget::onBBtnClicked() {}
+void CellWidget::onRecordBtnToggled(bool checked)
+{
+    m_session->setRecording(checked);
+    const QString fileName = m_session->recordFile();
+    m_recordBtn->setToolTip(fileName.isEmpty() ? tr("Record the video stream without re-encoding")
+                                               : tr("Recording to %1").arg(fileName));
+}
 
-void CellWidget::onCBtnClicked() {}
+void CellWidget::onReplayBtnClicked()
+{
+    m_session->saveReplay();
+}
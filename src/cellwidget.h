@@ -1,58 +1,57 @@
 #ifndef CELLWIDGET_H
 #define CELLWIDGET_H
 #include <QWidget>
-class QLabel;
+#include "cellsession.h"
 class QVBoxLayout;
 class QHBoxLayout;
 class QScrollArea;
 class QLineEdit;
 class QPushButton;
-class VideoThread;
-
-struct CellWidgetConf
-{
-    QString host{};
-    int port{};
-    int rows{};
-    int cols{};
-    int scale{};
-    int rate{};
-    bool fast{};
-};
+class ScreenWidget;
 
+// Shows a cell session with its own widgets: buttons for the decode mode
+// and recording, the device id, and the screen in a scroll area.
 class CellWidget : public QWidget
 {
     Q_OBJECT
 
 public:
-    CellWidget(QWidget *parent = nullptr);
+    explicit CellWidget(CellSession *session, QWidget *parent = nullptr);
     ~CellWidget();
 
-    void setDevice(const QString &deviceId);
-    void setConf(const CellWidgetConf &conf);
-
-    void start();
-    void stop();
+    CellSession *session() const;
 
 public slots:
-    void updateScreen(const QImage &image);
+    void updateScreen();
+    void updateStats();
+    void updateFrameSize(const QSize &size, int rotation);
+
+signals:
+    void detailRequested(CellSession *session);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+    void enterEvent(QEvent *event) override;
+    void leaveEvent(QEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
 
 private slots:
-    void onVideoFinished();
-    void onABtnClicked();
-    void onBBtnClicked();
-    void onCBtnClicked();
+    void onModeBtnClicked();
+    void onRecordBtnToggled(bool checked);
+    void onReplayBtnClicked();
 
 private:
-    CellWidgetConf m_conf{};
+    void updateModeBtn();
+    void updateToolTip();
+    void updateTargetSize();
+
+    CellSession *m_session{};
 
     QVBoxLayout *m_mainLayout{};
     QHBoxLayout *m_toolLayout{};
     QScrollArea *m_area{};
-    QLabel *m_screen{};
+    ScreenWidget *m_screen{};
     QLineEdit *m_deviceInp{};
-    QPushButton *m_aBtn{}, *m_bBtn{}, *m_cBtn{};
-
-    VideoThread *m_videoThread{};
+    QPushButton *m_modeBtn{}, *m_recordBtn{}, *m_replayBtn{};
 };
 #endif // CELLWIDGET_H
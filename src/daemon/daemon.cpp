@@ -0,0 +1,217 @@
+#include "daemon.h"
+#include <QDebug>
+#include <QDir>
+#include <QImage>
+#include <QPointer>
+#include <QRegExp>
+#include <QSaveFile>
+#include <QTextStream>
+#include "device/fastvideothread.h"
+#include "device/streamrecorder.h"
+#include "device/videosink.h"
+
+// how long stopping waits for a stream to close its recording
+static const unsigned long stopTimeoutMs = 5000;
+
+static QString deviceKey(const AdbServer &server, const QString &deviceId)
+{
+    return server.name() + '/' + deviceId;
+}
+
+Daemon::Daemon(const DaemonConf &conf, QObject *parent)
+    : QObject(parent)
+    , m_conf(conf)
+{
+    connect(&m_metricsTimer, &QTimer::timeout, this, &Daemon::writeMetrics);
+}
+
+Daemon::~Daemon()
+{
+    stop();
+}
+
+void Daemon::start()
+{
+    if (!m_conf.recordDir.isEmpty() && m_conf.backend == StreamHub::BackendScreencap) {
+        qWarning() << "WARNING: screencap has no video stream to record,"
+                   << "use screenrecord or scrcpy";
+    }
+    for (const AdbServer &server : m_conf.servers) {
+        auto tracker = new DeviceTracker(this);
+        connect(tracker, &DeviceTracker::devicesChanged, this, [this, tracker]() {
+            onDevicesChanged(tracker);
+        });
+        connect(tracker, &DeviceTracker::stateChanged, this, [tracker](DeviceTracker::State state) {
+            if (state == DeviceTracker::Waiting) {
+                qDebug() << "waiting for adb server" << tracker->server().name();
+            }
+        });
+        m_trackers.push_back(tracker);
+        tracker->start(server);
+    }
+    if (!m_conf.metricsFile.isEmpty()) {
+        m_metricsTimer.start(qMax(1, m_conf.metricsSeconds) * 1000);
+    }
+}
+
+void Daemon::stop()
+{
+    m_metricsTimer.stop();
+    for (auto tracker : m_trackers) {
+        tracker->disconnect(this);
+        tracker->stop();
+        tracker->deleteLater();
+    }
+    m_trackers.clear();
+
+    QList<QPointer<VideoThread>> threads;
+    for (const Device &device : m_devices) {
+        threads.append(device.sink->videoThread());
+    }
+    for (const QString &key : m_devices.keys()) {
+        removeDevice(key);
+    }
+    for (const QPointer<VideoThread> &thread : threads) {
+        if (thread && !thread->wait(stopTimeoutMs)) {
+            qWarning() << "WARNING: stream of" << thread->server() << "didn't stop in time";
+        }
+    }
+    // the streams hand their last packets to recorders that write on their own
+    StreamRecorder::waitForAll(stopTimeoutMs);
+}
+
+void Daemon::onDevicesChanged(DeviceTracker *tracker)
+{
+    const AdbServer server = tracker->server();
+    const QStringList devices = tracker->devices();
+    for (const QString &key : m_devices.keys()) {
+        const Device &device = m_devices[key];
+        if (device.server == server && !devices.contains(device.deviceId)) {
+            removeDevice(key);
+        }
+    }
+    for (const QString &deviceId : devices) {
+        if (!m_devices.contains(deviceKey(server, deviceId))) {
+            addDevice(server, deviceId);
+        }
+    }
+}
+
+void Daemon::addDevice(const AdbServer &server, const QString &deviceId)
+{
+    qDebug() << "starting" << deviceId << "on" << server.name();
+
+    StreamHub::Source source;
+    source.host = server.host;
+    source.port = server.port;
+    source.deviceId = deviceId;
+    source.backend = m_conf.backend;
+
+    const QString key = deviceKey(server, deviceId);
+    Device &device = m_devices[key];
+    device.server = server;
+    device.deviceId = deviceId;
+    device.sink = StreamHub::instance()->subscribe(source);
+
+    // a frame per snapshot, without snapshots just enough to keep the stream going
+    const bool snapshots = !m_conf.snapshotDir.isEmpty();
+    device.sink->setImageScalePercent(100);
+    device.sink->setDecodeMode(VideoThread::DecodeKeyframes);
+    device.sink->setImageRate(snapshots ? 1.0 / qMax(1, m_conf.snapshotSeconds)
+                                        : VideoSink::heartbeatRate());
+
+    connect(device.sink, &VideoSink::statsReady, this, [this, key](const VideoStats &stats) {
+        auto it = m_devices.find(key);
+        if (it != m_devices.end()) {
+            it->stats = stats;
+        }
+    });
+    if (snapshots) {
+        connect(device.sink, &VideoSink::imageReady, this, [this, key](const QImage &image) {
+            auto it = m_devices.find(key);
+            if (it != m_devices.end()) {
+                saveSnapshot(*it, image);
+            }
+        });
+    }
+
+    auto thread = qobject_cast<FastVideoThread *>(device.sink->videoThread());
+    if (thread && !m_conf.recordDir.isEmpty()) {
+        thread->setRecordFile(StreamRecorder::defaultFileName(server.name(),
+                                                              deviceId,
+                                                              "rec",
+                                                              m_conf.recordFormat,
+                                                              m_conf.recordDir));
+    }
+}
+
+void Daemon::removeDevice(const QString &key)
+{
+    auto it = m_devices.find(key);
+    if (it == m_devices.end()) {
+        return;
+    }
+    qDebug() << "stopping" << it->deviceId << "on" << it->server.name();
+    it->sink->disconnect(this);
+    StreamHub::instance()->unsubscribe(it->sink);
+    m_devices.erase(it);
+}
+
+void Daemon::saveSnapshot(const Device &device, const QImage &image)
+{
+    // the newest frame replaces the previous one, readers never see half a file
+    QDir().mkpath(m_conf.snapshotDir);
+    // named like the metrics labels, serials repeat across adb servers
+    QString name = deviceKey(device.server, device.deviceId);
+    name.replace(QRegExp("[^A-Za-z0-9._-]"), "_");
+    QSaveFile file(QString("%1/%2.png").arg(m_conf.snapshotDir, name));
+    if (!file.open(QIODevice::WriteOnly) || !image.save(&file, "PNG") || !file.commit()) {
+        qWarning() << "WARNING: can't save snapshot" << file.fileName();
+    }
+}
+
+void Daemon::writeMetrics()
+{
+    struct Metric
+    {
+        const char *name;
+        const char *help;
+        double (*value)(const VideoStats &stats);
+    };
+    static const Metric metrics[] = {
+        {"divvydroid_fps", "Frames decoded per second",
+         [](const VideoStats &s) { return s.fps; }},
+        {"divvydroid_decode_ms", "Average decode time of a frame",
+         [](const VideoStats &s) { return s.decodeMs; }},
+        {"divvydroid_dropped_packets", "Packets dropped to catch up",
+         [](const VideoStats &s) { return double(s.droppedPackets); }},
+        {"divvydroid_latency_ms", "Capture to arrival lag over the best seen, -1 when unknown",
+         [](const VideoStats &s) { return s.latencyMs; }},
+        {"divvydroid_ingress_kbps", "Stream data arriving from the device",
+         [](const VideoStats &s) { return s.ingressKbps; }},
+        {"divvydroid_bitrate_kbps", "Bitrate the device encoder was asked for",
+         [](const VideoStats &s) { return double(s.bitRateKbps); }},
+    };
+
+    QSaveFile file(m_conf.metricsFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "WARNING: can't write metrics" << m_conf.metricsFile;
+        return;
+    }
+    QTextStream out(&file);
+    out << "# HELP divvydroid_devices Devices being streamed\n"
+        << "# TYPE divvydroid_devices gauge\n"
+        << "divvydroid_devices " << m_devices.size() << "\n";
+    for (const Metric &metric : metrics) {
+        out << "# HELP " << metric.name << ' ' << metric.help << "\n"
+            << "# TYPE " << metric.name << " gauge\n";
+        for (const Device &device : m_devices) {
+            out << metric.name << "{server=\"" << device.server.name() << "\",device=\""
+                << device.deviceId << "\"} " << metric.value(device.stats) << "\n";
+        }
+    }
+    out.flush();
+    if (!file.commit()) {
+        qWarning() << "WARNING: can't write metrics" << m_conf.metricsFile;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+#include <QElapsedTimer>
+#include <QHash>
+#include <QTimer>
+#include <vector>
+#include "device/devicetracker.h"
+#include "device/streamhub.h"
+#include "device/videothread.h"
+
+class VideoSink;
+
+struct DaemonConf
+{
+    QList<AdbServer> servers{};
+    StreamHub::Backend backend{StreamHub::BackendScreenrecord};
+    // empty directories turn recording and snapshots off, an empty file metrics
+    QString recordDir{};
+    QString recordFormat{"mp4"};
+    QString snapshotDir{};
+    int snapshotSeconds{60};
+    QString metricsFile{};
+    int metricsSeconds{10};
+};
+
+// Runs the pipeline of every device of the configured adb servers without a
+// display: records the H.264 streams as they come, saves the newest frame of
+// each device now and then and writes stream stats in Prometheus text format.
+// Nothing is shown, so only keyframes are decoded and only for snapshots.
+class Daemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Daemon(const DaemonConf &conf, QObject *parent = nullptr);
+    ~Daemon();
+
+    void start();
+    // waits for the streams to finish their recordings
+    void stop();
+
+private slots:
+    void writeMetrics();
+
+private:
+    struct Device
+    {
+        AdbServer server{};
+        QString deviceId{};
+        VideoSink *sink{};
+        VideoStats stats{};
+    };
+
+    void onDevicesChanged(DeviceTracker *tracker);
+    void addDevice(const AdbServer &server, const QString &deviceId);
+    void removeDevice(const QString &key);
+    void saveSnapshot(const Device &device, const QImage &image);
+
+    DaemonConf m_conf{};
+    std::vector<DeviceTracker *> m_trackers{};
+    QHash<QString, Device> m_devices{};
+    QTimer m_metricsTimer{};
+};
+
+#endif // DAEMON_H
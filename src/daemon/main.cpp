@@ -0,0 +1,124 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QSettings>
+#include <QTimer>
+#include <csignal>
+#include "daemon.h"
+#include "device/bitratecontroller.h"
+#include "device/scrcpyvideothread.h"
+#include "device/startupscheduler.h"
+#include "device/streamserver.h"
+
+static volatile std::sig_atomic_t quitRequested = 0;
+
+static void requestQuit(int)
+{
+    quitRequested = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("divvydroidd");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Records, snapshots and reports on Android devices without a display.");
+    parser.addHelpOption();
+    const QCommandLineOption configOpt("config",
+                                       "Settings file, same keys as the GUI's settings.ini.",
+                                       "file",
+                                       "settings.ini");
+    const QCommandLineOption serversOpt("servers",
+                                        "adb servers, comma separated host or host:port.",
+                                        "list");
+    const QCommandLineOption backendOpt("backend", "screencap, screenrecord or scrcpy.", "name");
+    const QCommandLineOption recordDirOpt("record-dir",
+                                          "Record every device's stream to this directory.",
+                                          "dir");
+    const QCommandLineOption recordFormatOpt("record-format",
+                                             "Container of recordings, mp4 or mkv.",
+                                             "format");
+    const QCommandLineOption snapshotDirOpt("snapshot-dir",
+                                            "Save every device's newest frame to this directory.",
+                                            "dir");
+    const QCommandLineOption snapshotOpt("snapshot-interval",
+                                         "Seconds between snapshots.",
+                                         "seconds");
+    const QCommandLineOption metricsFileOpt(
+        "metrics-file", "Write stream stats to this file, Prometheus text format.", "file");
+    const QCommandLineOption metricsOpt("metrics-interval",
+                                        "Seconds between metrics updates.",
+                                        "seconds");
+    const QCommandLineOption servePortOpt("serve-port",
+                                          "Serve the H.264 streams over HTTP on this port.",
+                                          "port");
+    parser.addOptions({configOpt,
+                       serversOpt,
+                       backendOpt,
+                       recordDirOpt,
+                       recordFormatOpt,
+                       snapshotDirOpt,
+                       snapshotOpt,
+                       metricsFileOpt,
+                       metricsOpt,
+                       servePortOpt});
+    parser.process(app);
+
+    // command line wins over the file
+    QSettings settings(parser.value(configOpt), QSettings::IniFormat);
+    auto value = [&](const QCommandLineOption &option,
+                     const QString &key,
+                     const QVariant &defaultValue) {
+        return parser.isSet(option) ? QVariant(parser.value(option))
+                                    : settings.value(key, defaultValue);
+    };
+
+    DaemonConf conf;
+    conf.servers = AdbServer::parseList(
+        value(serversOpt, "daemon/servers", "127.0.0.1").toString());
+    const QString backend = value(backendOpt, "daemon/backend", "screenrecord").toString();
+    if (backend == "screencap") {
+        conf.backend = StreamHub::BackendScreencap;
+    } else if (backend == "scrcpy") {
+        conf.backend = StreamHub::BackendScrcpy;
+    } else {
+        conf.backend = StreamHub::BackendScreenrecord;
+    }
+    conf.recordDir = value(recordDirOpt, "daemon/recordDir", QString()).toString();
+    conf.recordFormat = value(recordFormatOpt, "daemon/recordFormat", conf.recordFormat).toString();
+    conf.snapshotDir = value(snapshotDirOpt, "daemon/snapshotDir", QString()).toString();
+    conf.snapshotSeconds =
+        value(snapshotOpt, "daemon/snapshotSeconds", conf.snapshotSeconds).toInt();
+    conf.metricsFile = value(metricsFileOpt, "daemon/metricsFile", QString()).toString();
+    conf.metricsSeconds = value(metricsOpt, "daemon/metricsSeconds", conf.metricsSeconds).toInt();
+
+    BitrateController::instance()->setBudget(
+        settings.value("bitrate/budgetMbps", 32).toLongLong() * 1000 * 1000);
+    const QString scrcpyVersion =
+        settings.value("scrcpy/version", ScrcpyVideoThread::serverVersion()).toString();
+    ScrcpyVideoThread::setServer(settings.value("scrcpy/server").toString(), scrcpyVersion);
+    ScrcpyVideoThread::setDefaultEndpoint(settings.value("scrcpy/endpoint").toString());
+    StartupScheduler::instance()->setMaxConcurrent(
+        settings.value("startup/maxConcurrent", 4).toInt());
+    if (!StreamServer::instance()->listen(value(servePortOpt, "server/port", 0).toInt())) {
+        return 1;
+    }
+
+    // recordings are only playable when they are finished, stop cleanly on signals
+    std::signal(SIGINT, requestQuit);
+    std::signal(SIGTERM, requestQuit);
+    QTimer quitTimer;
+    QObject::connect(&quitTimer, &QTimer::timeout, &app, [&app]() {
+        if (quitRequested) {
+            app.quit();
+        }
+    });
+    quitTimer.start(200);
+
+    Daemon daemon(conf);
+    daemon.start();
+    const int res = app.exec();
+    daemon.stop();
+    return res;
+}
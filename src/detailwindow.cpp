@@ -0,0 +1,120 @@
+#include "detailwindow.h"
+#include <QApplication>
+#include <QDesktopWidget>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QScrollArea>
+#include <QVBoxLayout>
+#include "device/videosink.h"
+#include "displayclock.h"
+#include "input/shellinput.h"
+#include "screenwidget.h"
+
+// rate and decode share of the stream while it is looked at up close
+static const double detailImageRate = 60;
+static const int detailDecodeWeight = 16;
+
+DetailWindow::DetailWindow(const StreamHub::Source &source, QWidget *parent)
+    : QWidget(parent, Qt::Window)
+{
+    setAttribute(Qt::WA_DeleteOnClose);
+    setWindowTitle(source.deviceId);
+    setFocusPolicy(Qt::StrongFocus);
+
+    m_area = new QScrollArea();
+    m_screen = new ScreenWidget();
+    m_area->setWidget(m_screen);
+    m_area->setAlignment(Qt::AlignCenter);
+    // keys are for the device, not for scrolling
+    m_area->setFocusPolicy(Qt::NoFocus);
+    m_screen->installEventFilter(this);
+
+    auto layout = new QVBoxLayout();
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(m_area);
+    setLayout(layout);
+
+    m_input = new ShellInput(source, this);
+
+    m_sink = StreamHub::instance()->subscribe(source);
+    m_sink->setImageScalePercent(100);
+    m_sink->setImageRate(detailImageRate);
+    m_sink->setDecodeMode(VideoThread::DecodeFull);
+    m_sink->setWeight(detailDecodeWeight);
+    connect(m_sink, &VideoSink::imageReady, this, &DetailWindow::onImageReady);
+    connect(DisplayClock::instance(), &DisplayClock::tick, this, [this]() {
+        if (!m_pendingImage.isNull()) {
+            updateScreen(m_pendingImage);
+            m_pendingImage = QImage();
+        }
+    });
+    connect(m_sink, &VideoSink::statsReady, this, &DetailWindow::updateStats);
+}
+
+DetailWindow::~DetailWindow()
+{
+    StreamHub::instance()->unsubscribe(m_sink);
+}
+
+void DetailWindow::onImageReady(const QImage &image)
+{
+    m_pendingImage = image;
+    DisplayClock::instance()->frameArrived();
+}
+
+void DetailWindow::updateScreen(const QImage &image)
+{
+    // one frame pixel per screen pixel
+    m_screen->setImage(image, devicePixelRatioF());
+    m_frameSize = image.size();
+
+    if (!m_resized) {
+        // open fitting the first frame, as far as the screen allows
+        m_resized = true;
+        const QRect available = QApplication::desktop()->availableGeometry(this);
+        resize(m_screen->size().boundedTo(available.size() * 0.9));
+    }
+}
+
+void DetailWindow::updateStats(const VideoStats &stats)
+{
+    m_screen->setToolTip(tr("%1 fps, decode %2 ms, dropped %3 packets")
+                             .arg(stats.fps, 0, 'f', 1)
+                             .arg(stats.decodeMs, 0, 'f', 1)
+                             .arg(stats.droppedPackets));
+}
+
+bool DetailWindow::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == m_screen && !m_frameSize.isEmpty()) {
+        if (event->type() == QEvent::MouseButtonPress) {
+            auto mev = static_cast<QMouseEvent *>(event);
+            if (mev->button() == Qt::LeftButton) {
+                m_input->press(mev->pos());
+                return true;
+            }
+        } else if (event->type() == QEvent::MouseButtonRelease) {
+            auto mev = static_cast<QMouseEvent *>(event);
+            if (mev->button() == Qt::LeftButton) {
+                m_input->release(mev->pos(), m_screen->size(), m_frameSize);
+                return true;
+            }
+        }
+    }
+    return QWidget::eventFilter(watched, event);
+}
+
+void DetailWindow::keyPressEvent(QKeyEvent *event)
+{
+    if (!m_input->key(event)) {
+        QWidget::keyPressEvent(event);
+    }
+}
+
+void DetailWindow::changeEvent(QEvent *event)
+{
+    if (event->type() == QEvent::WindowStateChange) {
+        m_sink->setVisibility(isMinimized() ? VideoSink::Hidden : VideoSink::Visible);
+    }
+    QWidget::changeEvent(event);
+}
@@ -0,0 +1,43 @@
+#ifndef DETAILWINDOW_H
+#define DETAILWINDOW_H
+#include <QWidget>
+#include "device/streamhub.h"
+class QScrollArea;
+class ScreenWidget;
+class ShellInput;
+class VideoSink;
+struct VideoStats;
+
+// A window showing one device at native resolution and every frame, mouse
+// and keyboard input are forwarded to the device.
+class DetailWindow : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit DetailWindow(const StreamHub::Source &source, QWidget *parent = nullptr);
+    ~DetailWindow();
+
+public slots:
+    void updateScreen(const QImage &image);
+    void updateStats(const VideoStats &stats);
+
+private slots:
+    void onImageReady(const QImage &image);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void changeEvent(QEvent *event) override;
+
+private:
+    QScrollArea *m_area{};
+    ScreenWidget *m_screen{};
+    VideoSink *m_sink{};
+    ShellInput *m_input{};
+    QImage m_pendingImage{};
+    QSize m_frameSize{};
+    bool m_resized{};
+};
+
+#endif // DETAILWINDOW_H
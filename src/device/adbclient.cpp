@@ -17,10 +17,12 @@
    along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "adbclient.h"
+#include <QDateTime>
 #include <QDebug>
 #include <QElapsedTimer>
 #include <QHostAddress>
 #include <QPixmap>
+#include <QtEndian>
 
 AdbClient::AdbClient(QObject *parent)
 	: QObject(parent)
@@ -208,19 +210,96 @@ bool AdbClient::connectToDevice()
 
 bool AdbClient::forwardTcpPort(int local, int remote)
 {
-    QByteArray cmd;
-    cmd = QByteArray("host-serial:").append(m_deviceId.toLatin1());
-    cmd.append("forward:tcp:")
-        .append(QString::number(local).toLatin1())
-        .append(";tcp:")
-        .append(QString::number(remote).toLatin1());
-    if (!send(cmd)) {
+    return forward("tcp:" + QByteArray::number(local), "tcp:" + QByteArray::number(remote));
+}
+
+int AdbClient::forwardLocalAbstract(const QString &socketName, int local)
+{
+    QByteArray resolved;
+    if (!forward("tcp:" + QByteArray::number(local),
+                 "localabstract:" + socketName.toLatin1(),
+                 &resolved)) {
+        return 0;
+    }
+    // with port 0 the server picks a free one and tells us which
+    return local ? local : resolved.toInt();
+}
+
+bool AdbClient::removeForward(int local)
+{
+    QByteArray cmd("host-serial:");
+    cmd.append(m_deviceId.toLatin1()).append(":killforward:tcp:").append(QByteArray::number(local));
+    const bool res = send(cmd);
+    close();
+    return res;
+}
+
+bool AdbClient::forward(const QByteArray &local, const QByteArray &remote, QByteArray *resolved)
+{
+    QByteArray cmd("host-serial:");
+    cmd.append(m_deviceId.toLatin1()).append(":forward:").append(local).append(';').append(remote);
+    // first OKAY acknowledges the request, second one the installed listener
+    if (!send(cmd) || !readStatus()) {
         qWarning() << "WARNING: unable to forward port to android device";
+        close();
         return false;
     }
+    if (resolved && local == "tcp:0") {
+        *resolved = readResponse();
+    }
+    close();
     return true;
 }
 
+bool AdbClient::push(const QByteArray &data, const QString &remotePath, int mode)
+{
+    // adb sync protocol: SEND "path,mode", DATA chunks, DONE mtime, then a status
+    static const int maxSyncChunk = 64 * 1024;
+
+    if (!connectToDevice()) {
+        return false;
+    }
+    if (!send("sync:")) {
+        qWarning() << "WARNING: unable to start file sync with android device";
+        return false;
+    }
+
+    const QByteArray spec = remotePath.toUtf8() + ',' + QByteArray::number(mode);
+    bool res = writeSyncRequest("SEND", spec.size()) && write(spec);
+    for (int offset = 0; res && offset < data.size(); offset += maxSyncChunk) {
+        const int len = qMin(maxSyncChunk, data.size() - offset);
+        res = writeSyncRequest("DATA", len) && write(data.constData() + offset, len);
+    }
+    res = res && writeSyncRequest("DONE", quint32(QDateTime::currentSecsSinceEpoch()));
+
+    char status[8];
+    if (!res || !read(status, sizeof(status))) {
+        qWarning() << "WARNING: failed pushing" << remotePath;
+        close();
+        return false;
+    }
+    if (memcmp(status, "OKAY", 4) != 0) {
+        const quint32 len = qMin<quint32>(qFromLittleEndian<quint32>(status + 4), 255);
+        QByteArray msg(int(len), 0);
+        read(msg.data(), len);
+        qWarning() << "WARNING: failed pushing" << remotePath << msg;
+        close();
+        return false;
+    }
+
+    writeSyncRequest("QUIT", 0);
+    close();
+    return true;
+}
+
+bool AdbClient::writeSyncRequest(const char *id, quint32 value)
+{
+    char req[8];
+    memcpy(req, id, 4);
+    qToLittleEndian(value, req + 4);
+    return write(req, sizeof(req));
+}
+
 QImage AdbClient::fetchScreenRaw()
 {
     FramebufInfo fbInfo{};
@@ -74,6 +74,9 @@ public:
 
     bool connectToDevice();
     bool forwardTcpPort(int local, int remote);
+    int forwardLocalAbstract(const QString &socketName, int local = 0);
+    bool removeForward(int local);
+    bool push(const QByteArray &data, const QString &remotePath, int mode = 0644);
     QImage fetchScreenRaw();
     QImage fetchScreenPng();
     QImage fetchScreenJpeg();
@@ -110,10 +113,14 @@ signals:
     void bytesWritten(qint64 bytes);
 
 private:
+    bool forward(const QByteArray &local, const QByteArray &remote, QByteArray *resolved = nullptr);
+    bool writeSyncRequest(const char *id, quint32 value);
+
     QString m_host{"127.0.0.1"};
     int m_port{5037};
     QString m_deviceId{};
-    QTcpSocket m_sock{};
+    // a child, so that moveToThread() takes the socket along
+    QTcpSocket m_sock{this};
 };
 
 #endif // ADBCLIENT_H
@@ -0,0 +1,149 @@
+/*
+   DivvyDroid - Application to screencast and remote control Android devices.
+
+   Copyright (C) 2019 - Mladen Milinkovic <maxrd2@smoothware.net>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "bitratecontroller.h"
+#include <QMutexLocker>
+
+// screenrecord and MediaCodec defaults are well below this, no point going higher
+static const int maxBitRate = 8 * 1000 * 1000;
+static const int minBitRate = 500 * 1000;
+static const int halfSizeBitRate = 1500 * 1000;
+// unread data piling up for this many reports in a row means the link can't keep up
+static const int behindReports = 2;
+static const double maxLatencyMs = 500.0;
+static const double decreaseFactor = 0.7;
+static const double increaseStep = 0.05;
+static const double minPenalty = 0.1;
+
+BitrateController *BitrateController::instance()
+{
+    static BitrateController controller;
+    return &controller;
+}
+
+int BitrateController::addStream(int weight, const QString &server)
+{
+    QMutexLocker lock(&m_mutex);
+    const int streamId = m_nextStreamId++;
+    m_streams[streamId].weight = qMax(1, weight);
+    m_streams[streamId].server = server;
+    return streamId;
+}
+
+void BitrateController::removeStream(int streamId)
+{
+    QMutexLocker lock(&m_mutex);
+    m_streams.erase(streamId);
+}
+
+void BitrateController::setWeight(int streamId, int weight)
+{
+    QMutexLocker lock(&m_mutex);
+    auto it = m_streams.find(streamId);
+    if (it != m_streams.end()) {
+        it->second.weight = qMax(1, weight);
+    }
+}
+
+void BitrateController::report(int streamId,
+                               qint64 bytes,
+                               qint64 elapsedMs,
+                               qint64 backlogBytes,
+                               double latencyMs)
+{
+    QMutexLocker lock(&m_mutex);
+    auto it = m_streams.find(streamId);
+    if (it == m_streams.end() || elapsedMs <= 0) {
+        return;
+    }
+    Stream &stream = it->second;
+
+    const double bps = bytes * 8000.0 / elapsedMs;
+    stream.ingressBps = stream.ingressBps ? stream.ingressBps * 0.7 + bps * 0.3 : bps;
+
+    const bool growing = backlogBytes > stream.backlogBytes && backlogBytes > bytes / 4;
+    stream.backlogBytes = backlogBytes;
+    if (growing || latencyMs > maxLatencyMs) {
+        stream.behindCount++;
+    } else {
+        stream.behindCount = 0;
+    }
+
+    if (stream.behindCount >= behindReports) {
+        stream.penalty = qMax(minPenalty, stream.penalty * decreaseFactor);
+        stream.behindCount = 0;
+    } else if (!stream.behindCount) {
+        stream.penalty = qMin(1.0, stream.penalty + increaseStep);
+    }
+}
+
+BitrateController::Target BitrateController::target(int streamId) const
+{
+    QMutexLocker lock(&m_mutex);
+    auto it = m_streams.find(streamId);
+    if (it == m_streams.end()) {
+        return Target();
+    }
+    return targetLocked(it->second, true);
+}
+
+BitrateController::Target BitrateController::fairTarget(int streamId) const
+{
+    QMutexLocker lock(&m_mutex);
+    auto it = m_streams.find(streamId);
+    if (it == m_streams.end()) {
+        return Target();
+    }
+    return targetLocked(it->second, false);
+}
+
+double BitrateController::ingressRate(int streamId) const
+{
+    QMutexLocker lock(&m_mutex);
+    auto it = m_streams.find(streamId);
+    return it != m_streams.end() ? it->second.ingressBps : 0.0;
+}
+
+void BitrateController::setBudget(qint64 bitsPerSecond)
+{
+    QMutexLocker lock(&m_mutex);
+    m_budget = bitsPerSecond;
+}
+
+qint64 BitrateController::budget() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_budget;
+}
+
+BitrateController::Target BitrateController::targetLocked(const Stream &stream, bool weighted) const
+{
+    int totalWeight{};
+    for (const auto &it : m_streams) {
+        if (it.second.server == stream.server) {
+            totalWeight += weighted ? it.second.weight : 1;
+        }
+    }
+
+    const int weight = weighted ? stream.weight : 1;
+    const double share = double(m_budget) * weight / qMax(1, totalWeight);
+    Target target;
+    target.bitRate = qMax(minBitRate, int(qMin<double>(share * stream.penalty, maxBitRate)));
+    target.halfSize = target.bitRate < halfSizeBitRate;
+    return target;
+}
@@ -0,0 +1,65 @@
+#ifndef BITRATECONTROLLER_H
+#define BITRATECONTROLLER_H
+#include <QMutex>
+#include <QString>
+#include <map>
+
+// Splits a bandwidth budget between the H.264 streams of each adb server, for
+// devices that share one USB hub or access point; streams of other servers
+// are on other hosts and don't take from it. Streams report what arrived and
+// how much is waiting unread every second; each gets a share of the budget
+// proportional to its weight, and a stream that keeps falling behind has its
+// share cut until it catches up (additive increase, multiplicative decrease).
+class BitrateController
+{
+public:
+    struct Target
+    {
+        int bitRate{};
+        // encoder output is halved in both dimensions when the share gets this small
+        bool halfSize{};
+    };
+
+    static BitrateController *instance();
+
+    int addStream(int weight = 1, const QString &server = QString());
+    void removeStream(int streamId);
+    void setWeight(int streamId, int weight);
+    void report(int streamId,
+                qint64 bytes,
+                qint64 elapsedMs,
+                qint64 backlogBytes,
+                double latencyMs);
+
+    // the weighted share, what an encoder is started with
+    Target target(int streamId) const;
+    // the share without weights, only moves with congestion and the number of
+    // streams, so focus changes alone don't restart encoders
+    Target fairTarget(int streamId) const;
+    double ingressRate(int streamId) const;
+
+    void setBudget(qint64 bitsPerSecond);
+    qint64 budget() const;
+
+private:
+    struct Stream
+    {
+        QString server{};
+        int weight{1};
+        double ingressBps{};
+        qint64 backlogBytes{};
+        int behindCount{};
+        double penalty{1.0};
+    };
+
+    BitrateController() = default;
+
+    Target targetLocked(const Stream &stream, bool weighted) const;
+
+    mutable QMutex m_mutex{};
+    std::map<int, Stream> m_streams{};
+    qint64 m_budget{32 * 1000 * 1000};
+    int m_nextStreamId{};
+};
+
+#endif // BITRATECONTROLLER_H
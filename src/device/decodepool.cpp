@@ -0,0 +1,187 @@
+/*
+   DivvyDroid - Application to screencast and remote control Android devices.
+
+   Copyright (C) 2019 - Mladen Milinkovic <maxrd2@smoothware.net>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "decodepool.h"
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QThread>
+
+namespace {
+class DecodeWorker : public QThread
+{
+public:
+    explicit DecodeWorker(const std::function<void()> &work)
+        : m_work{work}
+    {}
+
+protected:
+    void run() override { m_work(); }
+
+private:
+    std::function<void()> m_work;
+};
+} // namespace
+
+DecodePool::DecodePool(int threadCount)
+{
+    for (int i = 0; i < threadCount; i++) {
+        QThread *thread = new DecodeWorker([this]() { work(); });
+        thread->setObjectName(QString("decode%1").arg(i));
+        thread->start();
+        m_threads.push_back(thread);
+    }
+}
+
+DecodePool::~DecodePool()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stopping = true;
+        m_jobReady.wakeAll();
+    }
+    for (QThread *thread : m_threads) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+DecodePool *DecodePool::instance()
+{
+    static DecodePool pool(qMax(2, QThread::idealThreadCount()));
+    return &pool;
+}
+
+int DecodePool::addStream(int weight)
+{
+    QMutexLocker lock(&m_mutex);
+    const int streamId = m_nextStreamId++;
+    Stream &stream = m_streams[streamId];
+    stream.weight = qMax(1, weight);
+    stream.virtualTime = m_virtualTime;
+    return streamId;
+}
+
+void DecodePool::removeStream(int streamId)
+{
+    QMutexLocker lock(&m_mutex);
+    auto it = m_streams.find(streamId);
+    if (it == m_streams.end()) {
+        return;
+    }
+    it->second.jobs.clear();
+    // jobs reference the stream owner, it must not go away while one is running
+    while (it->second.running) {
+        m_jobDone.wait(&m_mutex);
+    }
+    m_streams.erase(it);
+}
+
+void DecodePool::setWeight(int streamId, int weight)
+{
+    QMutexLocker lock(&m_mutex);
+    auto it = m_streams.find(streamId);
+    if (it != m_streams.end()) {
+        it->second.weight = qMax(1, weight);
+    }
+}
+
+void DecodePool::submit(int streamId, const Job &job)
+{
+    QMutexLocker lock(&m_mutex);
+    auto it = m_streams.find(streamId);
+    if (it == m_streams.end()) {
+        return;
+    }
+    Stream &stream = it->second;
+    if (stream.jobs.empty() && !stream.running) {
+        // an idle stream doesn't get credit for the time it didn't use
+        stream.virtualTime = qMax(stream.virtualTime, m_virtualTime);
+    }
+    stream.jobs.push_back(job);
+    m_jobReady.wakeOne();
+}
+
+int DecodePool::queueDepth(int streamId) const
+{
+    QMutexLocker lock(&m_mutex);
+    auto it = m_streams.find(streamId);
+    return it != m_streams.end() ? int(it->second.jobs.size()) : 0;
+}
+
+double DecodePool::decodeTime(int streamId) const
+{
+    QMutexLocker lock(&m_mutex);
+    auto it = m_streams.find(streamId);
+    return it != m_streams.end() ? it->second.decodeMs : 0.0;
+}
+
+int DecodePool::threadCount() const
+{
+    return int(m_threads.size());
+}
+
+DecodePool::Stream *DecodePool::nextStream(int *streamId)
+{
+    Stream *next{};
+    for (auto &it : m_streams) {
+        Stream &stream = it.second;
+        if (stream.running || stream.jobs.empty()) {
+            continue;
+        }
+        if (!next || stream.virtualTime < next->virtualTime) {
+            next = &stream;
+            *streamId = it.first;
+        }
+    }
+    return next;
+}
+
+void DecodePool::work()
+{
+    QMutexLocker lock(&m_mutex);
+    while (!m_stopping) {
+        int streamId{};
+        Stream *stream = nextStream(&streamId);
+        if (!stream) {
+            m_jobReady.wait(&m_mutex);
+            continue;
+        }
+
+        Job job = stream->jobs.front();
+        stream->jobs.pop_front();
+        stream->running = true;
+        m_virtualTime = stream->virtualTime;
+
+        lock.unlock();
+        QElapsedTimer timer;
+        timer.start();
+        job();
+        const double elapsedMs = timer.nsecsElapsed() / 1000000.0;
+        job = {};
+        lock.relock();
+
+        // stream can't be removed while running, the pointer is still valid
+        stream->running = false;
+        stream->virtualTime += elapsedMs / stream->weight;
+        stream->decodeMs = stream->decodeMs * 0.9 + elapsedMs * 0.1;
+        m_jobDone.wakeAll();
+        if (!stream->jobs.empty()) {
+            m_jobReady.wakeOne();
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef DECODEPOOL_H
+#define DECODEPOOL_H
+#include <QMutex>
+#include <QWaitCondition>
+#include <deque>
+#include <functional>
+#include <map>
+#include <vector>
+
+class QThread;
+
+// Fixed-size set of worker threads shared by all video streams. Every stream
+// has its own job queue whose jobs run strictly in order, one at a time. Idle
+// workers pick the runnable stream with the lowest weighted virtual time, so a
+// stream with weight 8 gets roughly eight times the decode time of a weight 1
+// stream when the host is saturated.
+class DecodePool
+{
+public:
+    typedef std::function<void()> Job;
+
+    static DecodePool *instance();
+
+    int addStream(int weight = 1);
+    void removeStream(int streamId);
+    void setWeight(int streamId, int weight);
+    void submit(int streamId, const Job &job);
+
+    int queueDepth(int streamId) const;
+    double decodeTime(int streamId) const;
+    int threadCount() const;
+
+private:
+    struct Stream
+    {
+        std::deque<Job> jobs{};
+        int weight{1};
+        double virtualTime{};
+        double decodeMs{};
+        bool running{};
+    };
+
+    explicit DecodePool(int threadCount);
+    ~DecodePool();
+
+    void work();
+    Stream *nextStream(int *streamId);
+
+    mutable QMutex m_mutex{};
+    QWaitCondition m_jobReady{};
+    QWaitCondition m_jobDone{};
+    std::map<int, Stream> m_streams{};
+    std::vector<QThread *> m_threads{};
+    double m_virtualTime{};
+    int m_nextStreamId{};
+    bool m_stopping{};
+};
+
+#endif // DECODEPOOL_H
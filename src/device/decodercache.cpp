@@ -0,0 +1,108 @@
+/*
+   DivvyDroid - Application to screencast and remote control Android devices.
+
+   Copyright (C) 2019 - Mladen Milinkovic <maxrd2@smoothware.net>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "decodercache.h"
+#include <QMutexLocker>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+// a 1080p decoder holds tens of MB in its frame pools, keep about a screenful
+static const int maxCachedDecoders = 16;
+// decoders of devices that were not seen for a while are freed
+static const qint64 maxCachedAgeMs = 5 * 60 * 1000;
+
+DecoderCache::~DecoderCache()
+{
+    for (const Entry &entry : m_states) {
+        release(entry.state);
+    }
+}
+
+DecoderCache *DecoderCache::instance()
+{
+    static DecoderCache cache;
+    return &cache;
+}
+
+DecoderState *DecoderCache::take(const QString &deviceId)
+{
+    QMutexLocker lock(&m_mutex);
+    evictLocked();
+    m_order.removeOne(deviceId);
+    return m_states.take(deviceId).state;
+}
+
+void DecoderCache::put(const QString &deviceId, DecoderState *state)
+{
+    if (!state) {
+        return;
+    }
+    // drop the decoder's buffered frames and everything rebuilt on the first frame anyway
+    if (state->codecCtx) {
+        avcodec_flush_buffers(state->codecCtx);
+    }
+    av_frame_free(&state->frame);
+    for (ScalerState &scaler : state->scalers) {
+        release(scaler);
+    }
+    state->scalers.clear();
+
+    QMutexLocker lock(&m_mutex);
+    if (m_states.contains(deviceId)) {
+        release(m_states.take(deviceId).state);
+        m_order.removeOne(deviceId);
+    }
+    Entry &entry = m_states[deviceId];
+    entry.state = state;
+    entry.age.start();
+    m_order.append(deviceId);
+    evictLocked();
+}
+
+void DecoderCache::evictLocked()
+{
+    while (!m_order.isEmpty()
+           && (m_order.size() > maxCachedDecoders
+               || m_states.value(m_order.first()).age.elapsed() > maxCachedAgeMs)) {
+        release(m_states.take(m_order.takeFirst()).state);
+    }
+}
+
+void DecoderCache::release(DecoderState *state)
+{
+    if (!state) {
+        return;
+    }
+    for (ScalerState &scaler : state->scalers) {
+        release(scaler);
+    }
+    av_frame_free(&state->frame);
+    avcodec_parameters_free(&state->codecpar);
+    avcodec_free_context(&state->codecCtx);
+    delete state;
+}
+
+void DecoderCache::release(ScalerState &scaler)
+{
+    sws_freeContext(scaler.context);
+    scaler.context = nullptr;
+    av_frame_free(&scaler.scaledFrame);
+}
@@ -0,0 +1,74 @@
+#ifndef DECODERCACHE_H
+#define DECODERCACHE_H
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <vector>
+
+struct AVCodecContext;
+struct AVCodecParameters;
+struct AVFrame;
+struct SwsContext;
+
+// A scaler converting decoded frames to one output size.
+struct ScalerState
+{
+    SwsContext *context{};
+    AVFrame *scaledFrame{};
+
+    // what context was built for
+    int srcWidth{};
+    int srcHeight{};
+    int srcFormat{-1};
+    int dstWidth{};
+    int dstHeight{};
+    int flags{};
+    int threads{};
+};
+
+// Everything needed to go on decoding a device's stream after a reconnect:
+// the opened decoder, the stream parameters with SPS/PPS extradata, and one
+// scaler per output size, rebuilt only when resolution or pixel format change.
+struct DecoderState
+{
+    AVCodecContext *codecCtx{};
+    AVCodecParameters *codecpar{};
+    AVFrame *frame{};
+    std::vector<ScalerState> scalers{};
+};
+
+// Keeps decoder state of stopped streams by device id, so a new stream of the
+// same device can skip probing and decoder setup. Only the opened decoder and
+// the stream parameters are kept, frames and scalers are freed when a state
+// is put here, and only about as many as a grid shows for a few minutes.
+class DecoderCache
+{
+public:
+    static DecoderCache *instance();
+
+    DecoderState *take(const QString &deviceId);
+    void put(const QString &deviceId, DecoderState *state);
+
+    static void release(DecoderState *state);
+    static void release(ScalerState &scaler);
+
+private:
+    DecoderCache() = default;
+    ~DecoderCache();
+
+    struct Entry
+    {
+        DecoderState *state{};
+        QElapsedTimer age{};
+    };
+
+    void evictLocked();
+
+    QMutex m_mutex{};
+    QHash<QString, Entry> m_states{};
+    // oldest first
+    QStringList m_order{};
+};
+
+#endif // DECODERCACHE_H
@@ -0,0 +1,174 @@
+#include "devicetracker.h"
+#include <QDebug>
+#include <QSet>
+
+// a server that doesn't send a device list this long after connecting is given up on
+static const int answerTimeoutMs = 5000;
+static const int retryIntervalMs = 2000;
+
+QString AdbServer::name() const
+{
+    return QString("%1:%2").arg(host).arg(port);
+}
+
+QList<AdbServer> AdbServer::parseList(const QString &text, int defaultPort)
+{
+    QList<AdbServer> servers;
+    for (const QString &entry : text.split(',', Qt::SkipEmptyParts)) {
+        AdbServer server;
+        server.host = entry.trimmed();
+        server.port = defaultPort;
+        const int colon = server.host.lastIndexOf(':');
+        bool ok = false;
+        const int port = colon > 0 ? server.host.mid(colon + 1).toInt(&ok) : 0;
+        if (ok && port > 0 && port < 65536) {
+            server.port = port;
+            server.host.truncate(colon);
+        }
+        if (!server.host.isEmpty() && !servers.contains(server)) {
+            servers.append(server);
+        }
+    }
+    return servers;
+}
+
+DeviceTracker::DeviceTracker(QObject *parent)
+    : QObject(parent)
+{
+    m_timeout.setSingleShot(true);
+    m_retry.setSingleShot(true);
+    connect(&m_timeout, &QTimer::timeout, this, &DeviceTracker::onFailed);
+    connect(&m_retry, &QTimer::timeout, this, &DeviceTracker::connectToServer);
+    connect(&m_sock, &QTcpSocket::connected, this, &DeviceTracker::onConnected);
+    connect(&m_sock, &QTcpSocket::readyRead, this, &DeviceTracker::onReadyRead);
+    connect(&m_sock, &QTcpSocket::disconnected, this, &DeviceTracker::onFailed);
+    connect(&m_sock, &QTcpSocket::errorOccurred, this, &DeviceTracker::onFailed);
+}
+
+void DeviceTracker::start(const AdbServer &server)
+{
+    stop();
+    m_server = server;
+    connectToServer();
+}
+
+void DeviceTracker::stop()
+{
+    m_timeout.stop();
+    m_retry.stop();
+    m_sock.blockSignals(true);
+    m_sock.abort();
+    m_sock.blockSignals(false);
+    m_devices.clear();
+    setState(Stopped);
+}
+
+DeviceTracker::State DeviceTracker::state() const
+{
+    return m_state;
+}
+
+AdbServer DeviceTracker::server() const
+{
+    return m_server;
+}
+
+QStringList DeviceTracker::devices() const
+{
+    return m_devices;
+}
+
+void DeviceTracker::connectToServer()
+{
+    setState(Waiting);
+    m_buffer.clear();
+    m_statusRead = false;
+    m_sock.blockSignals(true);
+    m_sock.abort();
+    m_sock.blockSignals(false);
+    m_sock.connectToHost(m_server.host, m_server.port);
+    m_timeout.start(answerTimeoutMs);
+}
+
+void DeviceTracker::onConnected()
+{
+    const QByteArray cmd("host:track-devices");
+    m_sock.write(QString("%1").arg(cmd.size(), 4, 16, QChar('0')).toLatin1() + cmd);
+}
+
+void DeviceTracker::onReadyRead()
+{
+    m_buffer.append(m_sock.readAll());
+
+    if (!m_statusRead) {
+        if (m_buffer.size() < 4) {
+            return;
+        }
+        if (!m_buffer.startsWith("OKAY")) {
+            qWarning() << "WARNING: adb server" << m_server.name() << "refused to track devices";
+            onFailed();
+            return;
+        }
+        m_statusRead = true;
+        m_buffer.remove(0, 4);
+    }
+
+    // every change comes as a hex length and the complete list
+    while (m_buffer.size() >= 4) {
+        bool ok;
+        const int len = m_buffer.left(4).toInt(&ok, 16);
+        if (!ok) {
+            qWarning() << "WARNING: adb server" << m_server.name() << "sent an invalid device list";
+            onFailed();
+            return;
+        }
+        if (m_buffer.size() < 4 + len) {
+            break;
+        }
+        parseDevices(m_buffer.mid(4, len));
+        m_buffer.remove(0, 4 + len);
+        m_timeout.stop();
+        setState(Tracking);
+    }
+}
+
+void DeviceTracker::onFailed()
+{
+    if (m_state == Stopped || m_retry.isActive()) {
+        return;
+    }
+    // devices stay listed, they are likely still there once the server is back
+    m_timeout.stop();
+    m_sock.blockSignals(true);
+    m_sock.abort();
+    m_sock.blockSignals(false);
+    setState(Waiting);
+    m_retry.start(retryIntervalMs);
+}
+
+void DeviceTracker::setState(State state)
+{
+    if (m_state == state) {
+        return;
+    }
+    m_state = state;
+    emit stateChanged(state);
+}
+
+void DeviceTracker::parseDevices(const QByteArray &list)
+{
+    // "serial\tstate" per line
+    QStringList devices;
+    for (const QByteArray &line : list.split('\n')) {
+        const QList<QByteArray> fields = line.simplified().split(' ');
+        if (fields.size() >= 2 && fields.at(1) == "device") {
+            devices.append(QString::fromLatin1(fields.at(0)));
+        }
+    }
+    // adb may list the same devices in another order
+    if (QSet<QString>(devices.begin(), devices.end())
+        != QSet<QString>(m_devices.begin(), m_devices.end())) {
+        m_devices = devices;
+        emit devicesChanged(m_devices);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef DEVICETRACKER_H
+#define DEVICETRACKER_H
+#include <QObject>
+#include <QStringList>
+#include <QTcpSocket>
+#include <QTimer>
+
+// An adb server devices are reached through, usually one per USB host.
+struct AdbServer
+{
+    QString host{"127.0.0.1"};
+    int port{5037};
+
+    // "host:port"
+    QString name() const;
+    // comma separated "host" or "host:port" entries
+    static QList<AdbServer> parseList(const QString &text, int defaultPort = 5037);
+
+    bool operator==(const AdbServer &other) const
+    {
+        return host == other.host && port == other.port;
+    }
+    bool operator!=(const AdbServer &other) const { return !(*this == other); }
+};
+
+// Follows the devices of one adb server without blocking the thread it lives
+// in: host:track-devices makes the server send its device list whenever it
+// changes. A server that is down or doesn't answer in time is tried again
+// until it is back.
+class DeviceTracker : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum State {
+        Stopped,
+        Waiting,
+        Tracking,
+    };
+
+    explicit DeviceTracker(QObject *parent = nullptr);
+
+    void start(const AdbServer &server);
+    void stop();
+
+    State state() const;
+    AdbServer server() const;
+    // devices ready to use, without offline and unauthorized ones
+    QStringList devices() const;
+
+signals:
+    void stateChanged(DeviceTracker::State state);
+    void devicesChanged(const QStringList &devices);
+
+private slots:
+    void onConnected();
+    void onReadyRead();
+    void onFailed();
+
+private:
+    void connectToServer();
+    void setState(State state);
+    void parseDevices(const QByteArray &list);
+
+    AdbServer m_server{};
+    State m_state{Stopped};
+    QStringList m_devices{};
+
+    QTcpSocket m_sock{};
+    QByteArray m_buffer{};
+    bool m_statusRead{};
+    QTimer m_timeout{};
+    QTimer m_retry{};
+};
+
+#endif // DEVICETRACKER_H
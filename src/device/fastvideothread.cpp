@@ -23,7 +23,18 @@
 // https://stackoverflow.com/questions/34511312/how-to-encode-a-video-from-several-images-generated-in-a-c-program-without-wri
 
 #include "fastvideothread.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <algorithm>
+#include <memory>
 #include "adbclient.h"
+#include "bitratecontroller.h"
+#include "decodercache.h"
+#include "decodepool.h"
+#include "streamrecorder.h"
+#include "streamserver.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -34,91 +45,739 @@ extern "C" {
 #include <libswscale/swscale.h>
 }
 
+// sws_scale_frame() and the "threads" option came with FFmpeg 5.0
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+#define HAVE_SWS_THREADS
+#endif
+
+// packets waiting for a decode worker before the stream starts skipping to the next keyframe
+static const int maxQueuedPackets = 8;
+static const qint64 statsIntervalMs = 1000;
+// pause between reconnect attempts doubles up to the max while the device stays unreachable
+static const int minRetryDelayMs = 250;
+static const int maxRetryDelayMs = 4000;
+// encoder restarts cost a keyframe and a few hundred ms of video, don't do them often,
+// but don't keep taking more than the share for long, e.g. after a burst of new streams
+static const qint64 minRestartIntervalMs = 10000;
+static const qint64 minDecreaseIntervalMs = 3000;
+// distinct subscriber sizes a stream keeps scalers and frame buffers for
+static const size_t maxScalers = 4;
+
 FastVideoThread::FastVideoThread(QObject *parent)
     : VideoThread{parent}
 {}
 
 FastVideoThread::~FastVideoThread() {}
 
+void FastVideoThread::setRecordFile(const QString &fileName)
+{
+    QMutexLocker lock(&m_recordMutex);
+    m_recordFile = fileName;
+    m_recordSegment = 0;
+    m_recordChanged = true;
+}
+
+QString FastVideoThread::recordFile() const
+{
+    QMutexLocker lock(&m_recordMutex);
+    return m_recordFile;
+}
+
+void FastVideoThread::setReplayDuration(int seconds)
+{
+    m_replay.setDuration(seconds);
+}
+
+bool FastVideoThread::saveReplay(const QString &fileName, int seconds)
+{
+    return m_replay.save(fileName, seconds);
+}
+
+bool FastVideoThread::needsStream() const
+{
+    // recordings, replays and viewers must not have holes when the cell is hidden
+    return !recordFile().isEmpty() || m_replay.isEnabled()
+           || StreamServer::instance()->isWatched(server() + '/' + devInfo().deviceId);
+}
+
 void FastVideoThread::loop()
 {
-    if (!initStream()) {
+    DecodePool *pool = DecodePool::instance();
+    m_poolStream = pool->addStream(decodeWeight());
+    m_decoder = DecoderCache::instance()->take(server() + '/' + devInfo().deviceId);
+    m_streamClock.start();
+
+    BitrateController *bitrate = BitrateController::instance();
+    m_bitrateStream = bitrate->addStream(decodeWeight(), server());
+
+    int retryDelayMs = minRetryDelayMs;
+    while (!isInterruptionRequested()) {
+        if (isSuspended()) {
+            // nothing is shown, leave the device alone; reconnecting starts with an IDR
+            msleep(50);
+            continue;
+        }
+
+        if (!beginStartup()) {
+            break;
+        }
+
+        QElapsedTimer connectTimer;
+        connectTimer.start();
+
+        if (openStream()) {
+            qDebug() << "FRAMEBUFFER stream" << devInfo().deviceId << "ready in"
+                     << connectTimer.elapsed() << "ms";
+            readPackets();
+            if (connectTimer.elapsed() > 10 * maxRetryDelayMs) {
+                retryDelayMs = minRetryDelayMs;
+            }
+        }
         exitStream();
-        return;
+        // no frame came, let the others try while this one backs off
+        endStartup();
+
+        if (m_restartRequested || isSuspended()) {
+            // new encoder settings or suspended on purpose, no backoff
+            m_restartRequested = false;
+            retryDelayMs = minRetryDelayMs;
+            continue;
+        }
+
+        // screenrecord time limit, USB hiccup, adb restart... try again
+        for (int waitMs = 0; waitMs < retryDelayMs && !isInterruptionRequested(); waitMs += 50) {
+            msleep(50);
+        }
+        retryDelayMs = qMin(retryDelayMs * 2, maxRetryDelayMs);
     }
 
-    int streamIndex = getStreamIndex();
-    if (streamIndex == -1) {
-        exitStream();
-        return;
+    pool->removeStream(m_poolStream);
+    m_poolStream = -1;
+    bitrate->removeStream(m_bitrateStream);
+    m_bitrateStream = -1;
+
+    stopRecorder();
+
+    DecoderCache::instance()->put(server() + '/' + devInfo().deviceId, m_decoder);
+    m_decoder = nullptr;
+}
+
+bool FastVideoThread::openStream()
+{
+    if (m_decoder && (m_decoderMismatch || !m_decoder->codecpar)) {
+        resetDecoder();
+    }
+    m_decoderMismatch = false;
+    m_hasBaseDelay = false;
+    // taken only now, the other streams of a burst have registered while this
+    // one waited for its startup slot and the share already counts them
+    m_encoderTarget = BitrateController::instance()->target(m_bitrateStream);
+    m_fairTarget = BitrateController::instance()->fairTarget(m_bitrateStream);
+
+    if (!openSource() || !m_decoder || !initFrames()) {
+        return false;
     }
 
-    if (!initFrames()) {
-        return;
+    m_skipToKeyframe = true;
+    m_codecFrameSize = frameSize();
+    m_replay.setCodecParameters(m_decoder->codecpar);
+    const AVCodecParameters *codecpar = m_decoder->codecpar;
+    const QByteArray header(reinterpret_cast<const char *>(codecpar->extradata),
+                            codecpar->extradata_size);
+    StreamServer::instance()->setHeader(server() + '/' + devInfo().deviceId, header);
+    if (m_recorder && header != m_recorderHeader) {
+        // the file's extradata wouldn't match the new frames
+        QMutexLocker lock(&m_recordMutex);
+        m_recordSegment++;
+        m_recordChanged = true;
+    }
+    m_restartTimer.start();
+    return true;
+}
+
+bool FastVideoThread::openSource()
+{
+    // with cached parameters the stream is known to be raw H.264, don't probe it again
+    const bool cached = hasCachedDecoder();
+    if (!initStream(!cached)) {
+        return false;
+    }
+
+    if (cached) {
+        if (m_avFormat->nb_streams < 1) {
+            return false;
+        }
+        m_streamIndex = 0;
+        m_avStream = m_avFormat->streams[m_streamIndex];
+        avcodec_parameters_copy(m_avStream->codecpar, m_decoder->codecpar);
+    } else {
+        m_streamIndex = getStreamIndex();
+        if (m_streamIndex == -1) {
+            return false;
+        }
+    }
+    return initDecoder(m_avStream->codecpar);
+}
+
+int FastVideoThread::readSourcePacket(AVPacket *pkt, qint64 &devicePtsUs)
+{
+    // screenrecord doesn't tell when a frame was captured
+    devicePtsUs = -1;
+    for (;;) {
+        const int ret = av_read_frame(m_avFormat, pkt);
+        if (ret < 0 || pkt->stream_index == m_streamIndex) {
+            return ret;
+        }
+        av_packet_unref(pkt);
+    }
+}
+
+void FastVideoThread::closeSource()
+{
+    if (m_avFormat) {
+        AVIOContext *ioContext = m_avFormat->pb;
+        avformat_close_input(&m_avFormat);
+        avio_context_free(&ioContext);
     }
+    m_avStream = nullptr;
+    m_streamIndex = -1;
+    // next stream starts with a fresh screenrecord, so it begins with SPS/PPS again
+    adb()->close();
+}
+
+qint64 FastVideoThread::sourceBacklog()
+{
+    return adb()->bytesAvailable();
+}
+
+const BitrateController::Target &FastVideoThread::encoderTarget() const
+{
+    return m_encoderTarget;
+}
+
+QSize FastVideoThread::encoderSize() const
+{
+    if (!m_encoderTarget.halfSize) {
+        return QSize();
+    }
+    QSize size(devInfo().ovScreenWidth, devInfo().ovScreenHeight);
+    if (size.isEmpty()) {
+        size = QSize(devInfo().phScreenWidth, devInfo().phScreenHeight);
+    }
+    // follow the current orientation, encoders want multiples of 16
+    const QSize current = frameSize();
+    if (!current.isEmpty() && (current.width() > current.height()) != (size.width() > size.height())) {
+        size.transpose();
+    }
+    return QSize((size.width() / 2) & ~15, (size.height() / 2) & ~15);
+}
+
+bool FastVideoThread::hasCachedDecoder() const
+{
+    return m_decoder && m_decoder->codecpar;
+}
+
+bool FastVideoThread::initDecoder(const AVCodecParameters *codecpar)
+{
+    if (m_decoder && m_decoder->codecpar->codec_id != codecpar->codec_id) {
+        resetDecoder();
+    }
+
+    if (m_decoder) {
+        // frames of the previous connection are useless, decoding resumes at the next IDR
+        AVCodecContext *codecCtx = m_decoder->codecCtx;
+        DecodePool::instance()->submit(m_poolStream, [codecCtx]() {
+            avcodec_flush_buffers(codecCtx);
+        });
+        m_validateDecoder = true;
+        return true;
+    }
+
+    const AVCodec *dec = avcodec_find_decoder(codecpar->codec_id);
+    if (!dec) {
+        qDebug() << "FRAMEBUFFER can't find decoder";
+        return false;
+    }
+    AVCodecContext *codecCtx = avcodec_alloc_context3(dec);
+    if (!codecCtx) {
+        qDebug() << "FRAMEBUFFER can't allocate the decoder context";
+        return false;
+    }
+    int ret = avcodec_parameters_to_context(codecCtx, codecpar);
+    if (ret < 0) {
+        qDebug() << "FRAMEBUFFER failed to copy decoder parameters to decoder context"
+                 << streamError(ret);
+        avcodec_free_context(&codecCtx);
+        return false;
+    }
+    ret = avcodec_open2(codecCtx, dec, nullptr);
+    if (ret < 0) {
+        qDebug() << "FRAMEBUFFER failed to open decoder" << streamError(ret);
+        avcodec_free_context(&codecCtx);
+        return false;
+    }
+
+    m_decoder = new DecoderState;
+    m_decoder->codecCtx = codecCtx;
+    m_decoder->codecpar = avcodec_parameters_alloc();
+    if (!m_decoder->codecpar || avcodec_parameters_copy(m_decoder->codecpar, codecpar) < 0) {
+        DecoderCache::release(m_decoder);
+        m_decoder = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void FastVideoThread::readPackets()
+{
+    DecodePool *pool = DecodePool::instance();
+    int weight = decodeWeight();
+    pool->setWeight(m_poolStream, weight);
 
     AVPacket pkt;
     pkt.data = nullptr;
     pkt.size = 0;
 
-    while (!isInterruptionRequested()) {
-        int ret = av_read_frame(m_avFormat, &pkt);
-        bool drainDecoder = ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
-        if (ret < 0 && !drainDecoder) {
-            qDebug() << "FRAMEBUFFER av_read_frame() failed:" << streamError(ret);
+    QElapsedTimer statsTimer;
+    statsTimer.start();
+    DecodeMode decodeMode = this->decodeMode();
+    StreamServer *streamServer = StreamServer::instance();
+    const QString stream = server() + '/' + devInfo().deviceId;
+
+    while (!isInterruptionRequested() && !m_decoderMismatch && !isSuspended()) {
+        qint64 devicePtsUs{-1};
+        int ret = readSourcePacket(&pkt, devicePtsUs);
+        if (ret < 0) {
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+                qDebug() << "FRAMEBUFFER reading packet failed:" << streamError(ret);
+            }
             break;
         }
-        if (pkt.stream_index == streamIndex || drainDecoder) {
-            ret = avcodec_send_packet(m_codecCtx, &pkt);
-            if (ret < 0) {
-                if (ret != AVERROR(EAGAIN)) {
-                    qDebug() << "FRAMEBUFFER avcodec_send_packet() failed:" << streamError(ret);
-                    break;
-                }
-                continue;
+
+        const qint64 packetTimeUs = m_streamClock.nsecsElapsed() / 1000;
+        updateLatency(packetTimeUs, devicePtsUs);
+        m_bytesRead += pkt.size;
+        updateCodecSize();
+        m_replay.push(&pkt, packetTimeUs);
+        updateRecorder();
+        if (m_recorder) {
+            m_recorder->writePacket(&pkt, packetTimeUs);
+        }
+        if (streamServer->isWatched(stream)) {
+            streamServer->publish(stream, &pkt);
+        }
+
+        if (weight != decodeWeight()) {
+            weight = decodeWeight();
+            pool->setWeight(m_poolStream, weight);
+            BitrateController::instance()->setWeight(m_bitrateStream, weight);
+        }
+
+        // frames after the skipped ones reference them, full decoding starts at an IDR
+        if (decodeMode != this->decodeMode()) {
+            if (decodeMode == DecodeKeyframes) {
+                m_skipToKeyframe = true;
             }
+            decodeMode = this->decodeMode();
+        }
 
-            while (ret >= 0) {
-                ret = avcodec_receive_frame(m_codecCtx, m_frame);
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                    break;
-                }
-                if (ret < 0) {
-                    qDebug() << "FRAMEBUFFER avcodec_receive_frame() failed:" << streamError(ret);
-                    break;
-                }
+        // when decoding can't keep up, drop the backlog and resume at the next keyframe
+        if (pool->queueDepth(m_poolStream) >= maxQueuedPackets) {
+            m_skipToKeyframe = true;
+        } else if (m_skipToKeyframe && (pkt.flags & AV_PKT_FLAG_KEY)) {
+            m_skipToKeyframe = false;
+        }
 
-                sws_scale(m_swsContext,
-                          m_frame->data,
-                          m_frame->linesize,
-                          0,
-                          m_codecCtx->height,
-                          m_rgbFrame->data,
-                          m_rgbFrame->linesize);
-
-                QImage img(getScaledSize(m_codecCtx->width),
-                           getScaledSize(m_codecCtx->height),
-                           QImage::Format_RGB888);
-                const uint8_t *data = m_rgbFrame->data[0];
-                for (int y = 0; y < img.height(); ++y) {
-                    memcpy(img.scanLine(y), data, img.bytesPerLine());
-                    data += m_rgbFrame->linesize[0];
-                }
-                emit imageReady(img);
+        if (m_skipToKeyframe) {
+            m_droppedPackets++;
+        } else {
+            std::shared_ptr<AVPacket> job(av_packet_clone(&pkt), [](AVPacket *p) {
+                av_packet_free(&p);
+            });
+            if (job) {
+                pool->submit(m_poolStream, [this, job]() { decodePacket(job.get()); });
             }
         }
 
         av_packet_unref(&pkt);
 
-        if (drainDecoder) {
+        if (statsTimer.elapsed() >= statsIntervalMs) {
+            const qint64 elapsedMs = statsTimer.restart();
+            const double latencyMs = takeLatency();
+            updateBitrate(elapsedMs, latencyMs);
+            emitStats(elapsedMs, latencyMs);
+            if (m_restartRequested) {
+                break;
+            }
+        }
+    }
+}
+
+void FastVideoThread::resetDecoder()
+{
+    // wait for queued and running decode jobs, they still use the old decoder
+    DecodePool *pool = DecodePool::instance();
+    pool->removeStream(m_poolStream);
+    m_poolStream = pool->addStream(decodeWeight());
+
+    DecoderCache::release(m_decoder);
+    m_decoder = nullptr;
+}
+
+void FastVideoThread::updateCodecSize()
+{
+    // recorder, replay and stream server read the parameters on this thread only
+    // and only for sizes decoded since the stream opened, the previous
+    // stream's size is still set until the first frame
+    const QSize size = frameSize();
+    if (size == m_codecFrameSize) {
+        return;
+    }
+    m_codecFrameSize = size;
+    AVCodecParameters *codecpar = m_decoder->codecpar;
+    if (codecpar && !size.isEmpty()) {
+        codecpar->width = size.width();
+        codecpar->height = size.height();
+    }
+}
+
+void FastVideoThread::decodePacket(AVPacket *pkt)
+{
+    applyDecodeMode();
+
+    AVCodecContext *codecCtx = m_decoder->codecCtx;
+    AVFrame *frame = m_decoder->frame;
+    int ret = avcodec_send_packet(codecCtx, pkt);
+    if (ret < 0) {
+        if (ret != AVERROR(EAGAIN)) {
+            qDebug() << "FRAMEBUFFER avcodec_send_packet() failed:" << streamError(ret);
+        }
+        return;
+    }
+
+    while (ret >= 0) {
+        ret = avcodec_receive_frame(codecCtx, frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            break;
+        }
+        if (ret < 0) {
+            qDebug() << "FRAMEBUFFER avcodec_receive_frame() failed:" << streamError(ret);
             break;
         }
+
+        if (m_validateDecoder) {
+            // a new size is handled like a rotation below, a different pixel format isn't
+            m_validateDecoder = false;
+            const AVCodecParameters *codecpar = m_decoder->codecpar;
+            if (frame->format != codecpar->format) {
+                qDebug() << "FRAMEBUFFER cached decoder doesn't match the stream, probing again";
+                m_decoderMismatch = true;
+                return;
+            }
+        }
+
+        // references lost across a resolution change or reconnect, don't show the garbage
+        if ((frame->flags & AV_FRAME_FLAG_CORRUPT) || frame->decode_error_flags) {
+            continue;
+        }
+        endStartup();
+
+        // new SPS mid-stream, usually a rotation; the decoder reinitialized itself,
+        // scaler and frame pool follow the new size on their own, the stream's
+        // parameters are updated by the reading thread
+        updateFrameSize(QSize(frame->width, frame->height));
+
+        // every distinct subscriber size is converted once, straight into a
+        // pooled buffer that already is the QImage
+        const bool published = publishFrame(QSize(frame->width, frame->height),
+                                            [this, frame](const QSize &outSize) {
+                                                ScalerState *scaler = initScaler(frame, outSize);
+                                                if (!scaler) {
+                                                    return QImage();
+                                                }
+                                                QImage img = framePool(outSize).acquire(outSize.width(),
+                                                                                        outSize.height());
+                                                if (!img.isNull()) {
+                                                    scaleFrame(frame, *scaler, img);
+                                                }
+                                                return img;
+                                            });
+        if (published) {
+            m_framesEmitted++;
+        }
     }
+}
 
-    exitStream();
+int FastVideoThread::scaleFlags(const QSize &source, const QSize &target) const
+{
+    switch (scaleFilter()) {
+    case ScaleFastBilinear:
+        return SWS_FAST_BILINEAR;
+    case ScaleArea:
+        return SWS_AREA;
+    case ScaleBicubic:
+        return SWS_BICUBIC;
+    default:
+        break;
+    }
+    // thumbnails don't show the difference, bigger views do
+    const double ratio = double(target.width()) / source.width();
+    if (ratio <= 0.5) {
+        return SWS_FAST_BILINEAR;
+    }
+    if (ratio < 1.0) {
+        return SWS_AREA;
+    }
+    return SWS_BICUBIC;
 }
 
-bool FastVideoThread::initStream()
+ScalerState *FastVideoThread::initScaler(const AVFrame *frame, const QSize &outSize)
+{
+    const int flags = scaleFlags(QSize(frame->width, frame->height), outSize);
+#ifdef HAVE_SWS_THREADS
+    const int threads = qMax(1, scaleThreads());
+#else
+    const int threads = 1;
+#endif
+
+    std::vector<ScalerState> &scalers = m_decoder->scalers;
+    auto it = std::find_if(scalers.begin(), scalers.end(), [&outSize](const ScalerState &scaler) {
+        return scaler.dstWidth == outSize.width() && scaler.dstHeight == outSize.height();
+    });
+    if (it == scalers.end()) {
+        if (scalers.size() >= maxScalers) {
+            // least recently added size goes
+            DecoderCache::release(scalers.front());
+            scalers.erase(scalers.begin());
+        }
+        scalers.push_back(ScalerState());
+        it = scalers.end() - 1;
+    }
+    ScalerState &scaler = *it;
+    if (scaler.context && scaler.srcWidth == frame->width && scaler.srcHeight == frame->height
+        && scaler.srcFormat == frame->format && scaler.flags == flags
+        && scaler.threads == threads) {
+        return &scaler;
+    }
+
+    sws_freeContext(scaler.context);
+    scaler.context = sws_alloc_context();
+    if (!scaler.context) {
+        return nullptr;
+    }
+    // YUV to RGB conversion and resize happen in this one pass
+    av_opt_set_int(scaler.context, "srcw", frame->width, 0);
+    av_opt_set_int(scaler.context, "srch", frame->height, 0);
+    av_opt_set_int(scaler.context, "src_format", frame->format, 0);
+    av_opt_set_int(scaler.context, "dstw", outSize.width(), 0);
+    av_opt_set_int(scaler.context, "dsth", outSize.height(), 0);
+    av_opt_set_int(scaler.context, "dst_format", AV_PIX_FMT_RGB32, 0);
+    av_opt_set_int(scaler.context, "sws_flags", flags, 0);
+#ifdef HAVE_SWS_THREADS
+    av_opt_set_int(scaler.context, "threads", threads, 0);
+#endif
+    if (sws_init_context(scaler.context, nullptr, nullptr) < 0) {
+        qDebug() << "FRAMEBUFFER can't initialize scaler";
+        sws_freeContext(scaler.context);
+        scaler.context = nullptr;
+        return nullptr;
+    }
+
+    scaler.srcWidth = frame->width;
+    scaler.srcHeight = frame->height;
+    scaler.srcFormat = frame->format;
+    scaler.dstWidth = outSize.width();
+    scaler.dstHeight = outSize.height();
+    scaler.flags = flags;
+    scaler.threads = threads;
+    m_scaleFlagsUsed = flags;
+    m_scaleThreadsUsed = threads;
+    return &scaler;
+}
+
+void FastVideoThread::scaleFrame(const AVFrame *frame, ScalerState &scaler, QImage &img)
+{
+#ifdef HAVE_SWS_THREADS
+    if (scaler.threads > 1) {
+        if (!scaler.scaledFrame) {
+            scaler.scaledFrame = av_frame_alloc();
+        }
+        AVFrame *dst = scaler.scaledFrame;
+        if (dst) {
+            // sliced scaling only writes to frames it thinks it owns, lend it the pooled buffer
+            dst->buf[0] = av_buffer_create(img.bits(),
+                                           img.bytesPerLine() * img.height(),
+                                           [](void *, uint8_t *) {},
+                                           nullptr,
+                                           0);
+            dst->data[0] = img.bits();
+            dst->linesize[0] = img.bytesPerLine();
+            dst->width = img.width();
+            dst->height = img.height();
+            dst->format = AV_PIX_FMT_RGB32;
+            const int ret = dst->buf[0] ? sws_scale_frame(scaler.context, dst, frame) : -1;
+            av_frame_unref(dst);
+            if (ret >= 0) {
+                return;
+            }
+        }
+    }
+#endif
+    uint8_t *const dstData[4] = {img.bits(), nullptr, nullptr, nullptr};
+    const int dstLinesize[4] = {int(img.bytesPerLine()), 0, 0, 0};
+    sws_scale(scaler.context,
+              frame->data,
+              frame->linesize,
+              0,
+              frame->height,
+              dstData,
+              dstLinesize);
+}
+
+FramePool &FastVideoThread::framePool(const QSize &size)
+{
+    const quint64 key = (quint64(size.width()) << 32) | quint64(size.height());
+    if (m_framePools.size() >= maxScalers && !m_framePools.count(key)) {
+        // images still on screen keep their pool alive until they're released
+        m_framePools.clear();
+    }
+    return m_framePools[key];
+}
+
+void FastVideoThread::updateLatency(qint64 arrivalUs, qint64 devicePtsUs)
+{
+    if (devicePtsUs < 0) {
+        return;
+    }
+    // device and host clocks aren't synchronized, measure against the quickest packet
+    const qint64 delayUs = arrivalUs - devicePtsUs;
+    if (!m_hasBaseDelay || delayUs < m_baseDelayUs) {
+        m_baseDelayUs = delayUs;
+        m_hasBaseDelay = true;
+    }
+    m_latencySumMs += (delayUs - m_baseDelayUs) / 1000.0;
+    m_latencyCount++;
+}
+
+double FastVideoThread::takeLatency()
+{
+    if (!m_latencyCount) {
+        return -1;
+    }
+    const double latencyMs = m_latencySumMs / m_latencyCount;
+    m_latencySumMs = 0;
+    m_latencyCount = 0;
+    return latencyMs;
+}
+
+void FastVideoThread::updateBitrate(qint64 elapsedMs, double latencyMs)
+{
+    BitrateController *controller = BitrateController::instance();
+    controller->report(m_bitrateStream, m_bytesRead, elapsedMs, sourceBacklog(), latencyMs);
+    m_bytesRead = 0;
+
+    if (m_restartTimer.elapsed() < minDecreaseIntervalMs) {
+        return;
+    }
+    // Weights follow focus and hover, restarting for them would black out cells
+    // all over the grid. Restarts are for congestion and a changed number of
+    // streams, or for an encoder that sends well over a share it no longer has.
+    const BitrateController::Target fair = controller->fairTarget(m_bitrateStream);
+    const double fairRatio = double(fair.bitRate) / qMax(1, m_fairTarget.bitRate);
+    const bool linkChanged = fair.halfSize != m_fairTarget.halfSize || fairRatio <= 0.67
+                             || fairRatio >= 1.5;
+    const BitrateController::Target target = controller->target(m_bitrateStream);
+    const bool overShare = target.bitRate < m_encoderTarget.bitRate * 0.67
+                           && controller->ingressRate(m_bitrateStream) > target.bitRate * 1.5;
+    if (!linkChanged && !overShare) {
+        return;
+    }
+    if (!overShare && fairRatio > 0.67 && m_restartTimer.elapsed() < minRestartIntervalMs) {
+        return;
+    }
+    qDebug() << "FRAMEBUFFER" << devInfo().deviceId << "restarting encoder at"
+             << target.bitRate / 1000 << "kbps" << (target.halfSize ? "half size" : "");
+    m_encoderTarget = target;
+    m_fairTarget = fair;
+    m_restartRequested = true;
+}
+
+void FastVideoThread::emitStats(qint64 elapsedMs, double latencyMs)
+{
+    DecodePool *pool = DecodePool::instance();
+    VideoStats stats;
+    stats.fps = m_framesEmitted.exchange(0) * 1000.0 / qMax<qint64>(1, elapsedMs);
+    stats.queueDepth = pool->queueDepth(m_poolStream);
+    stats.decodeMs = pool->decodeTime(m_poolStream);
+    stats.droppedPackets = m_droppedPackets;
+    stats.scaler = scalerName(m_scaleFlagsUsed, m_scaleThreadsUsed);
+    stats.latencyMs = latencyMs;
+    stats.ingressKbps = BitrateController::instance()->ingressRate(m_bitrateStream) / 1000.0;
+    stats.bitRateKbps = m_encoderTarget.bitRate / 1000;
+    emit statsReady(stats);
+}
+
+void FastVideoThread::updateRecorder()
+{
+    QMutexLocker lock(&m_recordMutex);
+    if (!m_recordChanged) {
+        return;
+    }
+    m_recordChanged = false;
+
+    stopRecorder();
+    if (m_recordFile.isEmpty()) {
+        return;
+    }
+
+    // "name.mp4", "name-2.mp4", "name-3.mp4"...
+    m_segmentFile = m_recordFile;
+    if (m_recordSegment) {
+        const QFileInfo info(m_recordFile);
+        m_segmentFile = QString("%1/%2-%3.%4")
+                            .arg(info.path(), info.completeBaseName())
+                            .arg(m_recordSegment + 1)
+                            .arg(info.suffix());
+    }
+    const AVCodecParameters *codecpar = m_decoder->codecpar;
+    m_recorderHeader = QByteArray(reinterpret_cast<const char *>(codecpar->extradata),
+                                  codecpar->extradata_size);
+    m_recorder = new StreamRecorder(m_segmentFile, codecpar);
+    m_recorder->moveToThread(QCoreApplication::instance()->thread());
+    // recording turns off, the next packet stops the recorder
+    connect(m_recorder,
+            &StreamRecorder::failed,
+            this,
+            [this](const QString &fileName) {
+                QMutexLocker lock(&m_recordMutex);
+                if (m_segmentFile == fileName) {
+                    m_recordFile.clear();
+                    m_recordChanged = true;
+                }
+                lock.unlock();
+                emit recordFailed(fileName);
+            },
+            Qt::DirectConnection);
+    m_recorder->start();
+}
+
+void FastVideoThread::stopRecorder()
+{
+    if (!m_recorder) {
+        return;
+    }
+    // the writer outlives this stream when it still has packets to flush; it is
+    // deleted only after finish(), one that failed to open has finished already
+    m_recorder->disconnect(this);
+    m_recorder->finish();
+    connect(m_recorder, &StreamRecorder::finished, m_recorder, &StreamRecorder::deleteLater);
+    if (m_recorder->isFinished()) {
+        m_recorder->deleteLater();
+    }
+    m_recorder = nullptr;
+}
+
+bool FastVideoThread::initStream(bool probe)
 {
     auto read_packet = [](void *u, uint8_t *buf, int buf_size) -> int {
         auto *me = reinterpret_cast<FastVideoThread *>(u);
@@ -164,10 +823,14 @@ bool FastVideoThread::initStream()
     Q_ASSERT(m_avFormat->pb != nullptr);
 
     int ret{};
-    if ((ret = avformat_open_input(&m_avFormat, nullptr, nullptr, nullptr)) < 0) {
+    auto inputFormat = probe ? nullptr : av_find_input_format("h264");
+    if ((ret = avformat_open_input(&m_avFormat, nullptr, inputFormat, nullptr)) < 0) {
         qDebug() << "FRAMEBUFFER can't open input:" << streamError(ret);
         return false;
     }
+    if (!probe) {
+        return true;
+    }
 
     m_avFormat->probesize = 32;
     //	m_avFormat->max_analyze_duration = 0;
@@ -183,115 +846,69 @@ bool FastVideoThread::initStream()
 bool FastVideoThread::initFrames()
 {
     // AVFrame
-    m_frame = av_frame_alloc();
-    if (m_frame == nullptr) {
-        return false;
-    }
-
-    // AVFrame
-    m_rgbFrame = av_frame_alloc();
-    if (m_rgbFrame == nullptr) {
-        return false;
-    }
-
-    av_image_alloc(m_rgbFrame->data,
-                   m_rgbFrame->linesize,
-                   getScaledSize(m_codecCtx->width),
-                   getScaledSize(m_codecCtx->height),
-                   AV_PIX_FMT_RGB24,
-                   32);
-
-    // SWS
-    m_swsContext = sws_getContext(m_codecCtx->width,
-                                  m_codecCtx->height,
-                                  m_codecCtx->pix_fmt,
-                                  getScaledSize(m_codecCtx->width),
-                                  getScaledSize(m_codecCtx->height),
-                                  AV_PIX_FMT_RGB24,
-                                  SWS_BICUBIC,
-                                  nullptr,
-                                  nullptr,
-                                  nullptr);
-    if (m_swsContext == nullptr) {
-        return false;
+    if (!m_decoder->frame) {
+        m_decoder->frame = av_frame_alloc();
     }
+    // SWS context is created on first frame, when its size and format are known
+    return m_decoder->frame != nullptr;
+}
 
-    return true;
+void FastVideoThread::applyDecodeMode()
+{
+    // screenrecord emits an IDR every few seconds, in keyframe mode that is all we decode
+    const AVDiscard discard = decodeMode() == DecodeKeyframes ? AVDISCARD_NONKEY
+                                                               : AVDISCARD_DEFAULT;
+    m_decoder->codecCtx->skip_frame = discard;
 }
 
 int FastVideoThread::getStreamIndex()
 {
-    int streamIndex{-1};
-    int ret{};
-
     for (unsigned int i = 0; i < m_avFormat->nb_streams; i++) {
         m_avStream = m_avFormat->streams[i];
         if (m_avStream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO)
             continue;
 
-        const AVCodec *dec = avcodec_find_decoder(m_avStream->codecpar->codec_id);
-        if (!dec) {
+        if (!avcodec_find_decoder(m_avStream->codecpar->codec_id)) {
             qDebug() << "FRAMEBUFFER can't find decoder for stream" << i;
             continue;
         }
-
-        m_codecCtx = avcodec_alloc_context3(dec);
-        if (!m_codecCtx) {
-            qDebug() << "FRAMEBUFFER can't allocate the decoder context for stream" << i;
-            continue;
-        }
-        ret = avcodec_parameters_to_context(m_codecCtx, m_avStream->codecpar);
-        if (ret < 0) {
-            qDebug() << "FRAMEBUFFER failed to copy decoder parameters to input "
-                        "decoder context "
-                        "for stream"
-                     << i << streamError(ret);
-            avcodec_free_context(&m_codecCtx);
-            continue;
-        }
-        if (m_codecCtx->codec_type != AVMEDIA_TYPE_VIDEO) {
-            avcodec_free_context(&m_codecCtx);
-            continue;
-        }
-        ret = avcodec_open2(m_codecCtx, dec, nullptr);
-        if (ret < 0) {
-            qDebug() << "FRAMEBUFFER failed to open decoder for stream" << i << streamError(ret);
-            avcodec_free_context(&m_codecCtx);
-            continue;
-        }
-
-        streamIndex = i;
-        break;
+        return i;
     }
-
-    return streamIndex;
+    m_avStream = nullptr;
+    return -1;
 }
 
 void FastVideoThread::exitStream()
 {
-    if (m_swsContext) {
-        sws_freeContext(m_swsContext);
-    }
-    if (m_frame) {
-        av_frame_free(&m_frame);
-    }
-    if (m_rgbFrame) {
-        av_freep(&m_rgbFrame->data[0]);
-        av_frame_free(&m_rgbFrame);
-    }
-    if (m_codecCtx) {
-        avcodec_free_context(&m_codecCtx);
+    // decoder state is kept, the next connection resumes with it
+    closeSource();
+}
+
+QString FastVideoThread::scalerName(int flags, int threads)
+{
+    QString name;
+    switch (flags) {
+    case SWS_FAST_BILINEAR:
+        name = "fast bilinear";
+        break;
+    case SWS_AREA:
+        name = "area";
+        break;
+    case SWS_BICUBIC:
+        name = "bicubic";
+        break;
+    default:
+        return QString();
     }
-    if (m_avFormat) {
-        AVIOContext *ioContext = m_avFormat->pb;
-        avformat_close_input(&m_avFormat);
-        avio_context_free(&ioContext);
+    if (threads > 1) {
+        name.append(QString(" x%1 threads").arg(threads));
     }
+    return name;
 }
 
 const char *FastVideoThread::streamError(int errorCode)
 {
-    static char errorText[1024];
+    static thread_local char errorText[1024];
     av_strerror(errorCode, errorText, sizeof(errorText));
     return errorText;
 }
@@ -302,7 +919,14 @@ bool FastVideoThread::connectDevice()
         return false;
     }
 
-    QByteArray cmd("shell:stty raw; screenrecord --output-format=h264 -");
+    QByteArray cmd("shell:stty raw; screenrecord --output-format=h264");
+    cmd.append(" --bit-rate=").append(QByteArray::number(m_encoderTarget.bitRate));
+    const QSize size = encoderSize();
+    if (!size.isEmpty()) {
+        cmd.append(" --size=").append(QByteArray::number(size.width()));
+        cmd.append('x').append(QByteArray::number(size.height()));
+    }
+    cmd.append(" -");
 
     if (!adb()->send(cmd)) {
         qWarning() << "FRAMEBUFFER error executing" << cmd.mid(6);
@@ -1,15 +1,24 @@
 #ifndef FASTVIDEOTHREAD_H
 #define FASTVIDEOTHREAD_H
 
+#include <QElapsedTimer>
+#include <QMutex>
+#include <map>
+#include "bitratecontroller.h"
+#include "framepool.h"
+#include "replaybuffer.h"
 #include "videothread.h"
 
+struct AVCodecParameters;
 struct AVFormatContext;
 struct AVStream;
-struct AVCodecContext;
-struct SwsContext;
 struct AVFrame;
+struct AVPacket;
+struct DecoderState;
+struct ScalerState;
 
 class AdbClient;
+class StreamRecorder;
 
 class FastVideoThread : public VideoThread
 {
@@ -19,22 +28,97 @@ public:
     explicit FastVideoThread(QObject *parent = nullptr);
     virtual ~FastVideoThread();
 
+    void setRecordFile(const QString &fileName);
+    QString recordFile() const;
+    void setReplayDuration(int seconds);
+    bool saveReplay(const QString &fileName, int seconds);
+
+signals:
+    // recording stopped because the file couldn't be written
+    void recordFailed(const QString &fileName);
+
+protected:
+    // Where the H.264 packets come from. The default source is screenrecord
+    // demuxed by libavformat, subclasses may bring their own framing.
+    virtual bool openSource();
+    virtual int readSourcePacket(AVPacket *pkt, qint64 &devicePtsUs);
+    virtual void closeSource();
+    virtual qint64 sourceBacklog();
+
+    // what the bitrate controller asks the device encoder for
+    const BitrateController::Target &encoderTarget() const;
+    QSize encoderSize() const;
+
+    bool hasCachedDecoder() const;
+    bool initDecoder(const AVCodecParameters *codecpar);
+    const char *streamError(int errorCode);
+    bool needsStream() const override;
+
 private:
     void loop() override final;
-    bool initStream();
+    bool openStream();
+    void readPackets();
+    // the decoder's parameters follow the decoded size on the reading thread
+    void updateCodecSize();
+    void resetDecoder();
+    bool initStream(bool probe);
     int getStreamIndex();
     bool initFrames();
+    void applyDecodeMode();
+    void decodePacket(AVPacket *pkt);
+    int scaleFlags(const QSize &source, const QSize &target) const;
+    ScalerState *initScaler(const AVFrame *frame, const QSize &outSize);
+    void scaleFrame(const AVFrame *frame, ScalerState &scaler, QImage &img);
+    FramePool &framePool(const QSize &size);
+    void updateLatency(qint64 arrivalUs, qint64 devicePtsUs);
+    double takeLatency();
+    void updateBitrate(qint64 elapsedMs, double latencyMs);
+    void emitStats(qint64 elapsedMs, double latencyMs);
+    void updateRecorder();
+    void stopRecorder();
     void exitStream();
-    const char *streamError(int errorCode);
+    static QString scalerName(int flags, int threads);
 
     bool connectDevice();
 
     AVFormatContext *m_avFormat{};
     AVStream *m_avStream{};
-    AVCodecContext *m_codecCtx{};
-    SwsContext *m_swsContext{};
-    AVFrame *m_frame{};
-    AVFrame *m_rgbFrame{};
+    int m_streamIndex{-1};
+    DecoderState *m_decoder{};
+    std::atomic<bool> m_validateDecoder{};
+    std::atomic<bool> m_decoderMismatch{};
+    bool m_skipToKeyframe{};
+    QSize m_codecFrameSize{};
+    std::map<quint64, FramePool> m_framePools{};
+    int m_poolStream{-1};
+    int m_droppedPackets{};
+    std::atomic<int> m_framesEmitted{};
+    std::atomic<int> m_scaleFlagsUsed{};
+    std::atomic<int> m_scaleThreadsUsed{};
+
+    QElapsedTimer m_streamClock{};
+    // arrival minus device time of the fastest packet so far, the rest is lag
+    qint64 m_baseDelayUs{};
+    bool m_hasBaseDelay{};
+    double m_latencySumMs{};
+    int m_latencyCount{};
+
+    int m_bitrateStream{-1};
+    BitrateController::Target m_encoderTarget{};
+    // the unweighted share when the encoder started
+    BitrateController::Target m_fairTarget{};
+    QElapsedTimer m_restartTimer{};
+    qint64 m_bytesRead{};
+    bool m_restartRequested{};
+    mutable QMutex m_recordMutex{};
+    QString m_recordFile{};
+    bool m_recordChanged{};
+    // a restarted encoder with other parameters continues in a new file
+    int m_recordSegment{};
+    QString m_segmentFile{};
+    StreamRecorder *m_recorder{};
+    QByteArray m_recorderHeader{};
+    ReplayBuffer m_replay{};
 };
 
 #endif // FASTVIDEOTHREAD_H
@@ -0,0 +1,130 @@
+/*
+   DivvyDroid - Application to screencast and remote control Android devices.
+
+   Copyright (C) 2019 - Mladen Milinkovic <maxrd2@smoothware.net>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "framepool.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <vector>
+
+// swscale writes whole SIMD blocks, keep lines and buffers aligned for it
+static const int bufferAlignment = 32;
+
+struct FramePool::Shared
+{
+    ~Shared()
+    {
+        for (uchar *data : free) {
+            qFreeAligned(data);
+        }
+    }
+
+    QMutex mutex{};
+    std::vector<uchar *> free{};
+    int bufferSize{};
+    int maxFree{};
+};
+
+struct FramePool::Buffer
+{
+    std::shared_ptr<Shared> shared{};
+    uchar *data{};
+    int size{};
+};
+
+FramePool::FramePool(int maxFree)
+    : m_shared{std::make_shared<Shared>()}
+{
+    m_shared->maxFree = maxFree;
+}
+
+FramePool::~FramePool()
+{
+    clear();
+}
+
+QImage FramePool::acquire(int width, int height, QImage::Format format)
+{
+    Q_ASSERT(format == QImage::Format_RGB32 || format == QImage::Format_ARGB32
+             || format == QImage::Format_ARGB32_Premultiplied);
+
+    const int lineSize = bytesPerLine(width);
+    const int size = lineSize * height;
+    if (size <= 0) {
+        return QImage();
+    }
+
+    uchar *data{};
+    {
+        QMutexLocker lock(&m_shared->mutex);
+        if (m_shared->bufferSize != size) {
+            // frame size changed, buffers of the old size are useless now
+            for (uchar *old : m_shared->free) {
+                qFreeAligned(old);
+            }
+            m_shared->free.clear();
+            m_shared->bufferSize = size;
+        }
+        if (!m_shared->free.empty()) {
+            data = m_shared->free.back();
+            m_shared->free.pop_back();
+        }
+    }
+    if (!data) {
+        data = reinterpret_cast<uchar *>(qMallocAligned(size, bufferAlignment));
+        if (!data) {
+            return QImage();
+        }
+    }
+
+    auto buffer = new Buffer;
+    buffer->shared = m_shared;
+    buffer->data = data;
+    buffer->size = size;
+    return QImage(data, width, height, lineSize, format, &FramePool::release, buffer);
+}
+
+void FramePool::clear()
+{
+    QMutexLocker lock(&m_shared->mutex);
+    for (uchar *data : m_shared->free) {
+        qFreeAligned(data);
+    }
+    m_shared->free.clear();
+}
+
+int FramePool::bytesPerLine(int width)
+{
+    return (width * 4 + bufferAlignment - 1) & ~(bufferAlignment - 1);
+}
+
+void FramePool::release(void *info)
+{
+    auto buffer = reinterpret_cast<Buffer *>(info);
+    {
+        QMutexLocker lock(&buffer->shared->mutex);
+        Shared *shared = buffer->shared.get();
+        if (buffer->size == shared->bufferSize && int(shared->free.size()) < shared->maxFree) {
+            shared->free.push_back(buffer->data);
+            buffer->data = nullptr;
+        }
+    }
+    if (buffer->data) {
+        qFreeAligned(buffer->data);
+    }
+    delete buffer;
+}
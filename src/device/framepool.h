@@ -0,0 +1,29 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+#include <QImage>
+#include <memory>
+
+// Hands out 32-bit QImages backed by reusable, aligned buffers. When the last
+// copy of an image is released (on whichever thread that happens) the QImage
+// cleanup callback gives the buffer back to the pool instead of freeing it.
+class FramePool
+{
+public:
+    explicit FramePool(int maxFree = 4);
+    ~FramePool();
+
+    QImage acquire(int width, int height, QImage::Format format = QImage::Format_RGB32);
+    void clear();
+
+    static int bytesPerLine(int width);
+
+private:
+    struct Shared;
+    struct Buffer;
+
+    static void release(void *info);
+
+    std::shared_ptr<Shared> m_shared;
+};
+
+#endif // FRAMEPOOL_H
@@ -0,0 +1,214 @@
+/*
+   DivvyDroid - Application to screencast and remote control Android devices.
+
+   Copyright (C) 2019 - Mladen Milinkovic <maxrd2@smoothware.net>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "replaybuffer.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QMutexLocker>
+#include <cstring>
+#include "streamrecorder.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+std::atomic<qint64> ReplayBuffer::s_budget{512 * 1024 * 1024};
+std::atomic<qint64> ReplayBuffer::s_totalBytes{0};
+std::atomic<int> ReplayBuffer::s_enabledCount{0};
+
+static bool sameStream(const AVCodecParameters *a, const AVCodecParameters *b)
+{
+    return a->width == b->width && a->height == b->height
+           && a->extradata_size == b->extradata_size
+           && (a->extradata_size <= 0
+               || std::memcmp(a->extradata, b->extradata, size_t(a->extradata_size)) == 0);
+}
+
+ReplayBuffer::ReplayBuffer() {}
+
+ReplayBuffer::~ReplayBuffer()
+{
+    setDuration(0);
+    avcodec_parameters_free(&m_codecpar);
+}
+
+void ReplayBuffer::setDuration(int seconds)
+{
+    QMutexLocker lock(&m_mutex);
+    const qint64 durationUs = qint64(seconds) * 1000000;
+    if ((durationUs > 0) != (m_durationUs > 0)) {
+        s_enabledCount += durationUs > 0 ? 1 : -1;
+    }
+    m_durationUs = durationUs;
+    trim();
+}
+
+bool ReplayBuffer::isEnabled() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_durationUs > 0;
+}
+
+void ReplayBuffer::setCodecParameters(const AVCodecParameters *codecpar)
+{
+    QMutexLocker lock(&m_mutex);
+    // a restarted encoder may have another size, GOPs from before can't be
+    // written under the new SPS/PPS
+    if (m_codecpar && !sameStream(m_codecpar, codecpar)) {
+        freePackets();
+    }
+    if (!m_codecpar) {
+        m_codecpar = avcodec_parameters_alloc();
+    }
+    if (m_codecpar) {
+        avcodec_parameters_copy(m_codecpar, codecpar);
+    }
+}
+
+void ReplayBuffer::push(const AVPacket *pkt, qint64 timeUs)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_durationUs <= 0) {
+        return;
+    }
+    const bool isKey = pkt->flags & AV_PKT_FLAG_KEY;
+    if (m_packets.empty() && !isKey) {
+        return;
+    }
+
+    Entry entry;
+    entry.pkt = av_packet_clone(pkt);
+    entry.timeUs = timeUs;
+    if (!entry.pkt) {
+        return;
+    }
+    if (isKey) {
+        m_gopStarts.push_back(timeUs);
+    }
+    m_packets.push_back(entry);
+    m_bytes += pkt->size;
+    s_totalBytes += pkt->size;
+
+    trim();
+}
+
+void ReplayBuffer::clear()
+{
+    QMutexLocker lock(&m_mutex);
+    freePackets();
+}
+
+bool ReplayBuffer::save(const QString &fileName, int seconds)
+{
+    StreamRecorder *recorder{};
+    {
+        QMutexLocker lock(&m_mutex);
+        if (m_packets.empty() || !m_codecpar) {
+            return false;
+        }
+
+        // start at the last keyframe that still gives us the requested time
+        const qint64 fromUs = m_packets.back().timeUs - qint64(seconds) * 1000000;
+        qint64 startUs = m_gopStarts.front();
+        for (qint64 gopStart : m_gopStarts) {
+            if (gopStart > fromUs) {
+                break;
+            }
+            startUs = gopStart;
+        }
+
+        recorder = new StreamRecorder(fileName, m_codecpar);
+        recorder->setMaxQueuedPackets(int(m_packets.size()) + 1);
+        for (const Entry &entry : m_packets) {
+            if (entry.timeUs >= startUs) {
+                recorder->writePacket(entry.pkt, entry.timeUs);
+            }
+        }
+    }
+
+    recorder->finish();
+    recorder->moveToThread(QCoreApplication::instance()->thread());
+    QObject::connect(recorder, &StreamRecorder::finished, recorder, &StreamRecorder::deleteLater);
+    recorder->start();
+    return true;
+}
+
+void ReplayBuffer::setBudget(qint64 bytes)
+{
+    s_budget = bytes;
+}
+
+qint64 ReplayBuffer::budget()
+{
+    return s_budget;
+}
+
+qint64 ReplayBuffer::totalBytes()
+{
+    return s_totalBytes;
+}
+
+void ReplayBuffer::dropOldestGop()
+{
+    do {
+        Entry &entry = m_packets.front();
+        m_bytes -= entry.pkt->size;
+        s_totalBytes -= entry.pkt->size;
+        av_packet_free(&entry.pkt);
+        m_packets.pop_front();
+    } while (!m_packets.empty() && !(m_packets.front().pkt->flags & AV_PKT_FLAG_KEY));
+    m_gopStarts.pop_front();
+}
+
+void ReplayBuffer::trim()
+{
+    if (m_durationUs <= 0) {
+        freePackets();
+        return;
+    }
+    if (m_packets.empty()) {
+        return;
+    }
+
+    // the second GOP alone still covers the window, the first one isn't needed
+    const qint64 newestUs = m_packets.back().timeUs;
+    while (m_gopStarts.size() > 1 && m_gopStarts[1] <= newestUs - m_durationUs) {
+        dropOldestGop();
+    }
+
+    // every buffer gets an equal share of the global budget
+    const qint64 share = s_budget / qMax(1, s_enabledCount.load());
+    while (m_gopStarts.size() > 1 && m_bytes > share) {
+        dropOldestGop();
+    }
+    if (m_bytes > share) {
+        // a single GOP over the share, wait for the next keyframe and start over
+        freePackets();
+    }
+}
+
+void ReplayBuffer::freePackets()
+{
+    for (Entry &entry : m_packets) {
+        av_packet_free(&entry.pkt);
+    }
+    m_packets.clear();
+    m_gopStarts.clear();
+    s_totalBytes -= m_bytes;
+    m_bytes = 0;
+}
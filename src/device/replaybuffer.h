@@ -0,0 +1,57 @@
+#ifndef REPLAYBUFFER_H
+#define REPLAYBUFFER_H
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include <deque>
+
+struct AVCodecParameters;
+struct AVPacket;
+
+// Keeps the last few seconds of a compressed video stream in memory so they
+// can be written to a file after the fact. The buffer always starts with a
+// keyframe and whole GOPs are dropped from the front, both when they fall out
+// of the time window and when all buffers together exceed the global budget.
+class ReplayBuffer
+{
+public:
+    ReplayBuffer();
+    ~ReplayBuffer();
+
+    void setDuration(int seconds);
+    bool isEnabled() const;
+    void setCodecParameters(const AVCodecParameters *codecpar);
+    void push(const AVPacket *pkt, qint64 timeUs);
+    void clear();
+
+    bool save(const QString &fileName, int seconds);
+
+    static void setBudget(qint64 bytes);
+    static qint64 budget();
+    static qint64 totalBytes();
+
+private:
+    struct Entry
+    {
+        AVPacket *pkt{};
+        qint64 timeUs{};
+    };
+
+    void dropOldestGop();
+    void trim();
+    void freePackets();
+
+    mutable QMutex m_mutex{};
+    std::deque<Entry> m_packets{};
+    std::deque<qint64> m_gopStarts{};
+    AVCodecParameters *m_codecpar{};
+    qint64 m_durationUs{};
+    qint64 m_bytes{};
+
+    static std::atomic<qint64> s_budget;
+    static std::atomic<qint64> s_totalBytes;
+    // buffers with a duration, they share the budget
+    static std::atomic<int> s_enabledCount;
+};
+
+#endif // REPLAYBUFFER_H
@@ -0,0 +1,322 @@
+/*
+   DivvyDroid - Application to screencast and remote control Android devices.
+
+   Copyright (C) 2019 - Mladen Milinkovic <maxrd2@smoothware.net>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Protocol as spoken by scrcpy 2.x with tunnel_forward=true, see
+// https://github.com/Genymobile/scrcpy/blob/master/doc/develop.md
+
+#include "scrcpyvideothread.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+#include <QTcpSocket>
+#include <QtEndian>
+#include "adbclient.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+static const char *serverDevicePath = "/data/local/tmp/divvydroid-scrcpy-server.jar";
+// server needs a moment to start listening after app_process is launched
+static const int connectAttempts = 50;
+static const int connectRetryMs = 100;
+static const quint64 packetFlagConfig = quint64(1) << 63;
+static const quint64 packetFlagKey = quint64(1) << 62;
+static const quint64 packetPtsMask = packetFlagKey - 1;
+static const quint32 maxPacketSize = 16 * 1024 * 1024;
+static const quint32 codecIdH264 = 0x68323634; // "h264"
+static const int deviceNameLength = 64;
+
+QMutex ScrcpyVideoThread::s_serverMutex{};
+QString ScrcpyVideoThread::s_serverFile{};
+QString ScrcpyVideoThread::s_serverVersion{"2.4"};
+QString ScrcpyVideoThread::s_defaultEndpoint{};
+
+ScrcpyVideoThread::ScrcpyVideoThread(QObject *parent)
+    : FastVideoThread{parent}
+{
+    QMutexLocker lock(&s_serverMutex);
+    const int i = s_defaultEndpoint.lastIndexOf(':');
+    if (i > 0) {
+        m_endpointHost = s_defaultEndpoint.left(i);
+        m_endpointPort = s_defaultEndpoint.mid(i + 1).toInt();
+    }
+}
+
+ScrcpyVideoThread::~ScrcpyVideoThread() {}
+
+void ScrcpyVideoThread::setEndpoint(const QString &host, int port)
+{
+    m_endpointHost = host;
+    m_endpointPort = port;
+}
+
+void ScrcpyVideoThread::setDefaultEndpoint(const QString &endpoint)
+{
+    QMutexLocker lock(&s_serverMutex);
+    s_defaultEndpoint = endpoint;
+}
+
+void ScrcpyVideoThread::setServer(const QString &fileName, const QString &version)
+{
+    QMutexLocker lock(&s_serverMutex);
+    s_serverFile = fileName;
+    s_serverVersion = version;
+}
+
+QString ScrcpyVideoThread::serverFile()
+{
+    QMutexLocker lock(&s_serverMutex);
+    if (s_serverFile.isEmpty()) {
+        return QCoreApplication::applicationDirPath() + "/scrcpy-server";
+    }
+    return s_serverFile;
+}
+
+QString ScrcpyVideoThread::serverVersion()
+{
+    QMutexLocker lock(&s_serverMutex);
+    return s_serverVersion;
+}
+
+bool ScrcpyVideoThread::openSource()
+{
+    QString host = m_endpointHost;
+    int port = m_endpointPort;
+    if (!port) {
+        if (!startServer()) {
+            return false;
+        }
+        // adb forwards on the machine running the adb server
+        host = this->host();
+        port = m_localPort;
+    }
+    if (!connectVideo(host, port)) {
+        return false;
+    }
+
+    char deviceName[deviceNameLength + 1]{};
+    uchar codecMeta[12];
+    if (!readFully(deviceName, deviceNameLength) || !readFully(codecMeta, sizeof(codecMeta))) {
+        qDebug() << "FRAMEBUFFER scrcpy stream ended before codec meta";
+        return false;
+    }
+    if (qFromBigEndian<quint32>(codecMeta) != codecIdH264) {
+        qWarning() << "FRAMEBUFFER scrcpy stream is not H.264";
+        return false;
+    }
+    qDebug() << "FRAMEBUFFER scrcpy streaming" << deviceName;
+
+    AVCodecParameters *codecpar = avcodec_parameters_alloc();
+    if (!codecpar) {
+        return false;
+    }
+    codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    codecpar->codec_id = AV_CODEC_ID_H264;
+    codecpar->width = int(qFromBigEndian<quint32>(codecMeta + 4));
+    codecpar->height = int(qFromBigEndian<quint32>(codecMeta + 8));
+
+    // the encoder starts with its config packet, it's the stream's extradata
+    quint64 ptsFlags{};
+    quint32 size{};
+    m_config.clear();
+    if (readHeader(ptsFlags, size) && (ptsFlags & packetFlagConfig)) {
+        m_config.resize(int(size));
+        if (readFully(m_config.data(), size)) {
+            codecpar->extradata = reinterpret_cast<uint8_t *>(
+                av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE));
+            if (codecpar->extradata) {
+                memcpy(codecpar->extradata, m_config.constData(), size);
+                codecpar->extradata_size = int(size);
+            }
+        }
+    }
+    if (m_config.isEmpty()) {
+        qDebug() << "FRAMEBUFFER scrcpy stream didn't start with codec config";
+        avcodec_parameters_free(&codecpar);
+        return false;
+    }
+
+    const bool res = initDecoder(codecpar);
+    avcodec_parameters_free(&codecpar);
+    return res;
+}
+
+int ScrcpyVideoThread::readSourcePacket(AVPacket *pkt, qint64 &devicePtsUs)
+{
+    for (;;) {
+        quint64 ptsFlags{};
+        quint32 size{};
+        if (!readHeader(ptsFlags, size)) {
+            return AVERROR_EOF;
+        }
+
+        if (ptsFlags & packetFlagConfig) {
+            // resolution change or encoder restart, following keyframes need the new one
+            m_config.resize(int(size));
+            if (!readFully(m_config.data(), size)) {
+                return AVERROR_EOF;
+            }
+            continue;
+        }
+
+        // every keyframe carries the config, so replays and recordings can start at any GOP
+        const bool isKey = ptsFlags & packetFlagKey;
+        const int prefix = isKey ? m_config.size() : 0;
+        if (av_new_packet(pkt, prefix + int(size)) < 0) {
+            return AVERROR(ENOMEM);
+        }
+        if (prefix) {
+            memcpy(pkt->data, m_config.constData(), prefix);
+        }
+        if (!readFully(pkt->data + prefix, size)) {
+            av_packet_unref(pkt);
+            return AVERROR_EOF;
+        }
+
+        devicePtsUs = qint64(ptsFlags & packetPtsMask);
+        pkt->pts = pkt->dts = devicePtsUs;
+        if (isKey) {
+            pkt->flags |= AV_PKT_FLAG_KEY;
+        }
+        return 0;
+    }
+}
+
+void ScrcpyVideoThread::closeSource()
+{
+    if (m_videoSock) {
+        m_videoSock->abort();
+        delete m_videoSock;
+        m_videoSock = nullptr;
+    }
+    // closing the shell that runs it stops the server
+    adb()->close();
+    if (m_localPort) {
+        adb()->removeForward(m_localPort);
+        m_localPort = 0;
+    }
+}
+
+qint64 ScrcpyVideoThread::sourceBacklog()
+{
+    return m_videoSock ? m_videoSock->bytesAvailable() : 0;
+}
+
+bool ScrcpyVideoThread::startServer()
+{
+    if (!m_serverPushed) {
+        QFile file(serverFile());
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "FRAMEBUFFER can't read scrcpy server" << file.fileName();
+            return false;
+        }
+        if (!adb()->push(file.readAll(), serverDevicePath)) {
+            return false;
+        }
+        m_serverPushed = true;
+    }
+
+    // every server instance listens on its own socket
+    const QString scid = QString("%1").arg(QRandomGenerator::global()->bounded(0x7fffffff),
+                                           8,
+                                           16,
+                                           QChar('0'));
+    m_localPort = adb()->forwardLocalAbstract("scrcpy_" + scid);
+    if (!m_localPort) {
+        return false;
+    }
+
+    QByteArray cmd("shell:CLASSPATH=");
+    cmd.append(serverDevicePath)
+        .append(" app_process / com.genymobile.scrcpy.Server ")
+        .append(serverVersion().toLatin1())
+        .append(" scid=")
+        .append(scid.toLatin1())
+        .append(" tunnel_forward=true audio=false control=false cleanup=false"
+                " video_codec=h264 send_device_meta=true send_frame_meta=true"
+                " send_codec_meta=true send_dummy_byte=true");
+    cmd.append(" video_bit_rate=").append(QByteArray::number(encoderTarget().bitRate));
+    const QSize size = encoderSize();
+    if (!size.isEmpty()) {
+        cmd.append(" max_size=").append(QByteArray::number(qMax(size.width(), size.height())));
+    }
+    if (!adb()->connectToDevice() || !adb()->send(cmd)) {
+        qWarning() << "FRAMEBUFFER error starting scrcpy server";
+        return false;
+    }
+    return true;
+}
+
+bool ScrcpyVideoThread::connectVideo(const QString &host, int port)
+{
+    m_videoSock = new QTcpSocket();
+    m_videoSock->setSocketOption(QTcpSocket::LowDelayOption, 1);
+
+    // adb accepts the forwarded connection right away and closes it while the
+    // server isn't listening yet, the dummy byte says it is
+    for (int attempt = 0; attempt < connectAttempts && !isInterruptionRequested(); attempt++) {
+        m_videoSock->connectToHost(host, quint16(port));
+        char dummy{};
+        if (m_videoSock->waitForConnected(1000) && readFully(&dummy, 1)) {
+            return true;
+        }
+        m_videoSock->abort();
+        msleep(connectRetryMs);
+    }
+    qDebug() << "FRAMEBUFFER can't connect to scrcpy server on" << host << port;
+    return false;
+}
+
+bool ScrcpyVideoThread::readHeader(quint64 &ptsFlags, quint32 &size)
+{
+    uchar header[12];
+    if (!readFully(header, sizeof(header))) {
+        return false;
+    }
+    ptsFlags = qFromBigEndian<quint64>(header);
+    size = qFromBigEndian<quint32>(header + 8);
+    if (size == 0 || size > maxPacketSize) {
+        qDebug() << "FRAMEBUFFER invalid scrcpy packet size" << size;
+        return false;
+    }
+    return true;
+}
+
+bool ScrcpyVideoThread::readFully(void *data, qint64 size)
+{
+    char *dst = reinterpret_cast<char *>(data);
+    while (size > 0) {
+        if (!m_videoSock->bytesAvailable() && !m_videoSock->waitForReadyRead(50)) {
+            if (isInterruptionRequested()
+                || m_videoSock->error() != QAbstractSocket::SocketTimeoutError) {
+                return false;
+            }
+            continue;
+        }
+        const qint64 len = m_videoSock->read(dst, size);
+        if (len < 0) {
+            return false;
+        }
+        dst += len;
+        size -= len;
+    }
+    return true;
+}
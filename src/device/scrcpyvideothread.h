@@ -0,0 +1,55 @@
+#ifndef SCRCPYVIDEOTHREAD_H
+#define SCRCPYVIDEOTHREAD_H
+
+#include <QByteArray>
+#include <QMutex>
+#include "fastvideothread.h"
+
+class QTcpSocket;
+
+// Streams H.264 from a scrcpy server running on the device. Unlike
+// screenrecord it has no time limit and frames its packets itself: every
+// packet comes with its capture time and size, and codec config (SPS/PPS)
+// is sent as a separate packet, so no parser sits in between.
+class ScrcpyVideoThread : public FastVideoThread
+{
+    Q_OBJECT
+
+public:
+    explicit ScrcpyVideoThread(QObject *parent = nullptr);
+    virtual ~ScrcpyVideoThread();
+
+    // talk to an already running server instead of starting one on the device
+    void setEndpoint(const QString &host, int port);
+
+    static void setDefaultEndpoint(const QString &endpoint);
+    static void setServer(const QString &fileName, const QString &version);
+    static QString serverFile();
+    static QString serverVersion();
+
+protected:
+    bool openSource() override;
+    int readSourcePacket(AVPacket *pkt, qint64 &devicePtsUs) override;
+    void closeSource() override;
+    qint64 sourceBacklog() override;
+
+private:
+    bool startServer();
+    bool connectVideo(const QString &host, int port);
+    bool readHeader(quint64 &ptsFlags, quint32 &size);
+    bool readFully(void *data, qint64 size);
+
+    QString m_endpointHost{};
+    int m_endpointPort{};
+    int m_localPort{};
+    bool m_serverPushed{};
+    QTcpSocket *m_videoSock{};
+    QByteArray m_config{};
+
+    static QMutex s_serverMutex;
+    static QString s_serverFile;
+    static QString s_serverVersion;
+    static QString s_defaultEndpoint;
+};
+
+#endif // SCRCPYVIDEOTHREAD_H
@@ -0,0 +1,116 @@
+#include "startupscheduler.h"
+#include <QMutexLocker>
+#include "videothread.h"
+
+// a stream that holds its slot this long without a frame doesn't block others anymore
+static const qint64 connectTimeoutMs = 10000;
+// waiters look again this often, visibility may change while they wait
+static const unsigned long recheckMs = 100;
+
+StartupScheduler::StartupScheduler(QObject *parent)
+    : QObject(parent)
+{}
+
+StartupScheduler *StartupScheduler::instance()
+{
+    static StartupScheduler scheduler;
+    return &scheduler;
+}
+
+void StartupScheduler::setMaxConcurrent(int count)
+{
+    QMutexLocker lock(&m_mutex);
+    m_maxConcurrent = qMax(1, count);
+    m_released.wakeAll();
+}
+
+int StartupScheduler::maxConcurrent() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_maxConcurrent;
+}
+
+bool StartupScheduler::acquire(VideoThread *thread)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_waiting.isEmpty() && m_connecting.isEmpty()) {
+        m_connected = 0;
+    }
+    m_waiting.append(thread);
+    reportProgress();
+
+    const QString server = thread->server();
+    for (;;) {
+        if (thread->isInterruptionRequested()) {
+            m_waiting.removeOne(thread);
+            reportProgress();
+            m_released.wakeAll();
+            return false;
+        }
+        expireConnecting();
+        if (connectingTo(server) < m_maxConcurrent && nextWaiting(server) == thread) {
+            break;
+        }
+        m_released.wait(&m_mutex, recheckMs);
+    }
+
+    m_waiting.removeOne(thread);
+    m_connecting[thread].start();
+    return true;
+}
+
+void StartupScheduler::release(VideoThread *thread)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_connecting.remove(thread)) {
+        m_connected++;
+        reportProgress();
+    }
+    m_released.wakeAll();
+}
+
+VideoThread *StartupScheduler::nextWaiting(const QString &server) const
+{
+    // first come first served among the same priority
+    VideoThread *next{};
+    int nextPriority = -1;
+    for (VideoThread *thread : m_waiting) {
+        if (thread->server() != server) {
+            continue;
+        }
+        const int priority = thread->startupPriority();
+        if (priority > nextPriority) {
+            next = thread;
+            nextPriority = priority;
+        }
+    }
+    return next;
+}
+
+int StartupScheduler::connectingTo(const QString &server) const
+{
+    int count = 0;
+    for (auto it = m_connecting.begin(); it != m_connecting.end(); ++it) {
+        if (it.key()->server() == server) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void StartupScheduler::expireConnecting()
+{
+    for (auto it = m_connecting.begin(); it != m_connecting.end();) {
+        if (it.value().elapsed() > connectTimeoutMs) {
+            it = m_connecting.erase(it);
+            m_connected++;
+        } else {
+            ++it;
+        }
+    }
+}
+
+void StartupScheduler::reportProgress()
+{
+    emit progressChanged(m_connected, m_connected + m_connecting.size() + m_waiting.size());
+}
@@ -0,0 +1,52 @@
+#ifndef STARTUPSCHEDULER_H
+#define STARTUPSCHEDULER_H
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QWaitCondition>
+
+class VideoThread;
+
+// Lets only a few streams connect at a time. Connecting means device info
+// shells and starting the capture, which the adb server runs one after the
+// other anyway; too many at once only makes some of them time out. Each adb
+// server gets its own slots, servers on other hosts don't wait for each other.
+// Waiting streams that can be seen go first.
+class StartupScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    static StartupScheduler *instance();
+
+    void setMaxConcurrent(int count);
+    int maxConcurrent() const;
+
+    // blocks the stream's thread until it may connect, false when it was interrupted
+    bool acquire(VideoThread *thread);
+    // connected and showing frames, or given up
+    void release(VideoThread *thread);
+
+signals:
+    // streams connected of all that wanted to since the scheduler was last idle
+    void progressChanged(int connected, int total);
+
+private:
+    explicit StartupScheduler(QObject *parent = nullptr);
+
+    VideoThread *nextWaiting(const QString &server) const;
+    int connectingTo(const QString &server) const;
+    void expireConnecting();
+    void reportProgress();
+
+    mutable QMutex m_mutex{};
+    QWaitCondition m_released{};
+    int m_maxConcurrent{4};
+    QList<VideoThread *> m_waiting{};
+    QHash<VideoThread *, QElapsedTimer> m_connecting{};
+    int m_connected{};
+};
+
+#endif // STARTUPSCHEDULER_H
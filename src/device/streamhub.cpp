@@ -0,0 +1,160 @@
+/*
+   DivvyDroid - Application to screencast and remote control Android devices.
+
+   Copyright (C) 2019 - Mladen Milinkovic <maxrd2@smoothware.net>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "streamhub.h"
+#include "fastvideothread.h"
+#include "scrcpyvideothread.h"
+#include "streamserver.h"
+#include "videosink.h"
+
+StreamHub::StreamHub(QObject *parent)
+    : QObject(parent)
+{}
+
+StreamHub *StreamHub::instance()
+{
+    static StreamHub hub;
+    return &hub;
+}
+
+VideoSink *StreamHub::subscribe(const Source &source)
+{
+    if (source.backend != BackendScreencap) {
+        StreamServer::instance()->addSource(source);
+    }
+    const QString key = sourceKey(source);
+    Stream &stream = m_streams[key];
+    if (!stream.thread) {
+        stream.thread = createThread(source);
+        // the stream outlives the hub entry while it shuts down
+        connect(stream.thread, &VideoThread::finished, stream.thread, &VideoThread::deleteLater);
+    }
+
+    auto sink = new VideoSink();
+    sink->m_thread = stream.thread;
+    connect(stream.thread, &VideoThread::statsReady, sink, &VideoSink::statsReady);
+    connect(stream.thread, &VideoThread::frameSizeChanged, sink, &VideoSink::frameSizeChanged);
+    connect(sink, &VideoSink::settingsChanged, this, &StreamHub::onSinkSettingsChanged);
+    stream.sinks.append(sink);
+    stream.thread->addSink(sink);
+
+    updateThread(stream);
+    if (!stream.thread->isRunning()) {
+        stream.thread->start();
+    }
+    return sink;
+}
+
+void StreamHub::unsubscribe(VideoSink *sink)
+{
+    if (!sink) {
+        return;
+    }
+    const QString key = findStream(sink);
+    if (!key.isEmpty()) {
+        Stream &stream = m_streams[key];
+        stream.thread->removeSink(sink);
+        stream.sinks.removeAll(sink);
+        if (stream.sinks.isEmpty()) {
+            stream.thread->requestInterruption();
+            m_streams.remove(key);
+        } else {
+            updateThread(stream);
+        }
+    }
+    sink->deleteLater();
+}
+
+void StreamHub::onSinkSettingsChanged()
+{
+    const QString key = findStream(qobject_cast<VideoSink *>(sender()));
+    if (!key.isEmpty()) {
+        updateThread(m_streams.value(key));
+    }
+}
+
+QString StreamHub::sourceKey(const Source &source)
+{
+    return QString("%1:%2/%3/%4")
+        .arg(source.host)
+        .arg(source.port)
+        .arg(source.deviceId)
+        .arg(source.backend);
+}
+
+VideoThread *StreamHub::createThread(const Source &source)
+{
+    VideoThread *thread{};
+    switch (source.backend) {
+    case BackendScrcpy:
+        thread = new ScrcpyVideoThread();
+        break;
+    case BackendScreenrecord:
+        thread = new FastVideoThread();
+        break;
+    default:
+        thread = new VideoThread();
+        thread->setImageFormat(VideoThread::ImagePng);
+        break;
+    }
+    thread->setHost(source.host, source.port);
+    thread->setDevice(source.deviceId);
+    return thread;
+}
+
+void StreamHub::updateThread(const Stream &stream)
+{
+    // decode for the most demanding subscriber that can be seen
+    int decodeMode = VideoThread::DecodeKeyframes;
+    int weight = 1;
+    double rate = 0;
+    bool covered = false;
+    for (const VideoSink *sink : stream.sinks) {
+        if (sink->visibility() == VideoSink::Visible) {
+            decodeMode = qMin<int>(decodeMode, sink->decodeMode());
+            weight = qMax(weight, sink->weight());
+            rate = qMax(rate, sink->imageRate());
+        } else if (sink->visibility() == VideoSink::Covered) {
+            covered = true;
+        }
+    }
+    // covered streams keep decoding keyframes for the heartbeat, hidden ones stop
+    if (rate == 0 && covered) {
+        rate = VideoSink::heartbeatRate();
+    }
+    // a suspended stream that is still needed only keeps the heartbeat
+    stream.thread->setSuspended(rate == 0);
+    if (rate == 0) {
+        rate = VideoSink::heartbeatRate();
+    }
+    stream.thread->setDecodeMode(VideoThread::DecodeMode(decodeMode));
+    stream.thread->setDecodeWeight(weight);
+    // the focused stream may spread its color conversion over a few cores
+    stream.thread->setScaleThreads(weight > 1 ? qMax(2, QThread::idealThreadCount() / 2) : 1);
+    stream.thread->setImageRate(rate);
+}
+
+QString StreamHub::findStream(const VideoSink *sink) const
+{
+    for (auto it = m_streams.cbegin(); it != m_streams.cend(); ++it) {
+        if (it.value().sinks.contains(const_cast<VideoSink *>(sink))) {
+            return it.key();
+        }
+    }
+    return QString();
+}
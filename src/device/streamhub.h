@@ -0,0 +1,55 @@
+#ifndef STREAMHUB_H
+#define STREAMHUB_H
+#include <QHash>
+#include <QList>
+#include <QObject>
+
+class VideoSink;
+class VideoThread;
+
+// Owns one capture and decode pipeline per device and hands its frames to
+// every subscribed VideoSink. The pipeline starts with the first subscriber
+// and stops with the last one; in between it decodes as much as the most
+// demanding subscriber needs.
+class StreamHub : public QObject
+{
+    Q_OBJECT
+
+public:
+    // screencap grabs stills, the others stream H.264
+    enum Backend { BackendScreencap, BackendScreenrecord, BackendScrcpy };
+
+    struct Source
+    {
+        QString host{"127.0.0.1"};
+        int port{5037};
+        QString deviceId{};
+        Backend backend{BackendScreencap};
+    };
+
+    static StreamHub *instance();
+
+    VideoSink *subscribe(const Source &source);
+    void unsubscribe(VideoSink *sink);
+
+private slots:
+    void onSinkSettingsChanged();
+
+private:
+    struct Stream
+    {
+        VideoThread *thread{};
+        QList<VideoSink *> sinks{};
+    };
+
+    explicit StreamHub(QObject *parent = nullptr);
+
+    static QString sourceKey(const Source &source);
+    static VideoThread *createThread(const Source &source);
+    void updateThread(const Stream &stream);
+    QString findStream(const VideoSink *sink) const;
+
+    QHash<QString, Stream> m_streams{};
+};
+
+#endif // STREAMHUB_H
@@ -0,0 +1,257 @@
+/*
+   DivvyDroid - Application to screencast and remote control Android devices.
+
+   Copyright (C) 2019 - Mladen Milinkovic <maxrd2@smoothware.net>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// See also
+// https://ffmpeg.org/doxygen/trunk/remuxing_8c-example.html
+
+#include "streamrecorder.h"
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QDebug>
+#include <QDir>
+#include <QMutexLocker>
+#include <QRegExp>
+#include <QStandardPaths>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+QMutex StreamRecorder::s_recordersMutex;
+std::set<StreamRecorder *> StreamRecorder::s_recorders;
+
+StreamRecorder::StreamRecorder(const QString &fileName,
+                               const AVCodecParameters *codecpar,
+                               QObject *parent)
+    : QThread{parent}
+    , m_fileName{fileName}
+{
+    m_codecpar = avcodec_parameters_alloc();
+    if (m_codecpar && codecpar) {
+        avcodec_parameters_copy(m_codecpar, codecpar);
+    }
+    QMutexLocker lock(&s_recordersMutex);
+    s_recorders.insert(this);
+}
+
+StreamRecorder::~StreamRecorder()
+{
+    {
+        QMutexLocker lock(&s_recordersMutex);
+        s_recorders.erase(this);
+    }
+    finish();
+    wait();
+    for (AVPacket *pkt : m_packets) {
+        av_packet_free(&pkt);
+    }
+    avcodec_parameters_free(&m_codecpar);
+}
+
+QString StreamRecorder::fileName() const
+{
+    return m_fileName;
+}
+
+void StreamRecorder::setMaxQueuedPackets(int count)
+{
+    QMutexLocker lock(&m_mutex);
+    m_maxQueuedPackets = size_t(qMax(1, count));
+}
+
+void StreamRecorder::writePacket(const AVPacket *pkt, qint64 timeUs)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_finishing) {
+        return;
+    }
+    // a recording must start with a keyframe, and restart with one after an overflow
+    if (!m_gotKeyframe && !(pkt->flags & AV_PKT_FLAG_KEY)) {
+        return;
+    }
+    // how far the writer may fall behind before the recording skips to the next keyframe
+    if (m_packets.size() >= m_maxQueuedPackets) {
+        qWarning() << "RECORDER" << m_fileName << "writer is falling behind, dropping packets";
+        m_gotKeyframe = false;
+        return;
+    }
+    AVPacket *copy = av_packet_clone(pkt);
+    if (!copy) {
+        return;
+    }
+    copy->pts = copy->dts = timeUs;
+    copy->stream_index = 0;
+    m_packets.push_back(copy);
+    m_gotKeyframe = true;
+    m_packetReady.wakeOne();
+}
+
+void StreamRecorder::finish()
+{
+    QMutexLocker lock(&m_mutex);
+    m_finishing = true;
+    m_packetReady.wakeOne();
+}
+
+QString StreamRecorder::defaultFileName(const QString &server,
+                                        const QString &deviceId,
+                                        const QString &prefix,
+                                        const QString &format,
+                                        const QString &outputDir)
+{
+    QString dir = outputDir;
+    if (dir.isEmpty()) {
+        dir = QStandardPaths::writableLocation(QStandardPaths::MoviesLocation);
+        if (dir.isEmpty()) {
+            dir = QDir::currentPath();
+        }
+        dir.append("/DivvyDroid");
+    }
+    QDir().mkpath(dir);
+
+    QString device = server + '_' + deviceId;
+    device.replace(QRegExp("[^A-Za-z0-9._-]"), "_");
+    return QString("%1/%2-%3-%4.%5")
+        .arg(dir, prefix, device, QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"), format);
+}
+
+bool StreamRecorder::waitForAll(unsigned long timeoutMs)
+{
+    std::set<StreamRecorder *> recorders;
+    {
+        QMutexLocker lock(&s_recordersMutex);
+        recorders = s_recorders;
+    }
+    QDeadlineTimer deadline(timeoutMs);
+    bool finished = true;
+    for (StreamRecorder *recorder : recorders) {
+        if (!recorder->wait(deadline)) {
+            qWarning() << "WARNING: recording" << recorder->fileName() << "didn't finish in time";
+            finished = false;
+        }
+    }
+    return finished;
+}
+
+void StreamRecorder::run()
+{
+    if (!openOutput()) {
+        closeOutput();
+        {
+            QMutexLocker lock(&m_mutex);
+            m_finishing = true;
+        }
+        emit failed(m_fileName);
+        return;
+    }
+
+    QMutexLocker lock(&m_mutex);
+    for (;;) {
+        while (m_packets.empty() && !m_finishing) {
+            m_packetReady.wait(&m_mutex);
+        }
+        if (m_packets.empty()) {
+            break;
+        }
+        AVPacket *pkt = m_packets.front();
+        m_packets.pop_front();
+
+        lock.unlock();
+        muxPacket(pkt);
+        av_packet_free(&pkt);
+        lock.relock();
+    }
+    lock.unlock();
+
+    av_write_trailer(m_outFormat);
+    closeOutput();
+    qDebug() << "RECORDER finished" << m_fileName;
+}
+
+bool StreamRecorder::openOutput()
+{
+    const QByteArray fileName = m_fileName.toLocal8Bit();
+    int ret = avformat_alloc_output_context2(&m_outFormat, nullptr, nullptr, fileName.constData());
+    if (ret < 0 || !m_outFormat) {
+        qWarning() << "RECORDER can't create output context for" << m_fileName;
+        return false;
+    }
+
+    m_outStream = avformat_new_stream(m_outFormat, nullptr);
+    if (!m_outStream || avcodec_parameters_copy(m_outStream->codecpar, m_codecpar) < 0) {
+        qWarning() << "RECORDER can't create output stream for" << m_fileName;
+        return false;
+    }
+    m_outStream->codecpar->codec_tag = 0;
+    m_outStream->time_base = AVRational{1, 90000};
+
+    if (!(m_outFormat->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&m_outFormat->pb, fileName.constData(), AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            qWarning() << "RECORDER can't open" << m_fileName;
+            return false;
+        }
+    }
+
+    ret = avformat_write_header(m_outFormat, nullptr);
+    if (ret < 0) {
+        qWarning() << "RECORDER can't write header to" << m_fileName;
+        return false;
+    }
+
+    qDebug() << "RECORDER started" << m_fileName;
+    return true;
+}
+
+void StreamRecorder::closeOutput()
+{
+    if (!m_outFormat) {
+        return;
+    }
+    if (!(m_outFormat->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&m_outFormat->pb);
+    }
+    avformat_free_context(m_outFormat);
+    m_outFormat = nullptr;
+    m_outStream = nullptr;
+}
+
+void StreamRecorder::muxPacket(AVPacket *pkt)
+{
+    // packets carry their arrival time, recording time starts at the first one
+    if (m_firstTimeUs < 0) {
+        m_firstTimeUs = pkt->pts;
+    }
+    qint64 ts = av_rescale_q(pkt->pts - m_firstTimeUs,
+                             AVRational{1, AV_TIME_BASE},
+                             m_outStream->time_base);
+    if (ts <= m_lastDts) {
+        ts = m_lastDts + 1;
+    }
+    m_lastDts = ts;
+    pkt->pts = pkt->dts = ts;
+    pkt->duration = 0;
+    pkt->pos = -1;
+
+    const int ret = av_interleaved_write_frame(m_outFormat, pkt);
+    if (ret < 0) {
+        qWarning() << "RECORDER error writing packet to" << m_fileName;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef STREAMRECORDER_H
+#define STREAMRECORDER_H
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <deque>
+#include <set>
+
+struct AVCodecParameters;
+struct AVFormatContext;
+struct AVPacket;
+struct AVStream;
+
+// Remuxes compressed video packets into a MP4/Matroska file on its own
+// thread. Nothing is decoded or re-encoded, packets are only stamped with
+// their arrival time and handed to libavformat.
+class StreamRecorder : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit StreamRecorder(const QString &fileName,
+                            const AVCodecParameters *codecpar,
+                            QObject *parent = nullptr);
+    ~StreamRecorder();
+
+    QString fileName() const;
+    void setMaxQueuedPackets(int count);
+
+    void writePacket(const AVPacket *pkt, qint64 timeUs);
+    void finish();
+
+    // the adb server "host:port" is part of the name, serials repeat across
+    // servers; an empty dir is DivvyDroid in the user's videos
+    static QString defaultFileName(const QString &server,
+                                   const QString &deviceId,
+                                   const QString &prefix,
+                                   const QString &format,
+                                   const QString &dir = QString());
+    // waits for every recorder that is still writing, false if one didn't finish in time
+    static bool waitForAll(unsigned long timeoutMs);
+
+signals:
+    // the file couldn't be opened, packets are dropped until finish()
+    void failed(const QString &fileName);
+
+private:
+    void run() override;
+    bool openOutput();
+    void closeOutput();
+    void muxPacket(AVPacket *pkt);
+
+    QString m_fileName{};
+    AVCodecParameters *m_codecpar{};
+    AVFormatContext *m_outFormat{};
+    AVStream *m_outStream{};
+    qint64 m_firstTimeUs{-1};
+    qint64 m_lastDts{-1};
+
+    QMutex m_mutex{};
+    QWaitCondition m_packetReady{};
+    std::deque<AVPacket *> m_packets{};
+    size_t m_maxQueuedPackets{512};
+    bool m_gotKeyframe{};
+    bool m_finishing{};
+
+    // finished recorders are deleted on the main thread, which waitForAll() blocks
+    static QMutex s_recordersMutex;
+    static std::set<StreamRecorder *> s_recorders;
+};
+
+#endif // STREAMRECORDER_H
@@ -0,0 +1,272 @@
+#include "streamserver.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrl>
+#include "videosink.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// a few seconds of a full rate stream, a viewer further behind starts over at a keyframe
+static const qint64 maxQueuedBytes = 4 * 1024 * 1024;
+// what is handed to a socket at once, the rest waits shared in the queue
+static const qint64 maxSocketBytes = 256 * 1024;
+static const int maxRequestSize = 8192;
+
+StreamServer::StreamServer(QObject *parent)
+    : QObject(parent)
+{
+    // streams may be the first to ask for the server, it belongs to the main thread
+    moveToThread(QCoreApplication::instance()->thread());
+    connect(this,
+            &StreamServer::packetPublished,
+            this,
+            &StreamServer::onPacketPublished,
+            Qt::QueuedConnection);
+    connect(this,
+            &StreamServer::headerChanged,
+            this,
+            &StreamServer::onHeaderChanged,
+            Qt::QueuedConnection);
+}
+
+StreamServer *StreamServer::instance()
+{
+    static StreamServer server;
+    return &server;
+}
+
+bool StreamServer::listen(int port)
+{
+    delete m_server;
+    m_server = nullptr;
+    if (port <= 0) {
+        return true;
+    }
+    m_server = new QTcpServer(this);
+    connect(m_server, &QTcpServer::newConnection, this, &StreamServer::onNewConnection);
+    if (!m_server->listen(QHostAddress::Any, quint16(port))) {
+        qWarning() << "WARNING: can't serve streams on port" << port << m_server->errorString();
+        delete m_server;
+        m_server = nullptr;
+        return false;
+    }
+    return true;
+}
+
+int StreamServer::port() const
+{
+    return m_server ? m_server->serverPort() : 0;
+}
+
+QString StreamServer::streamName(const StreamHub::Source &source)
+{
+    return QString("%1:%2/%3").arg(source.host).arg(source.port).arg(source.deviceId);
+}
+
+void StreamServer::addSource(const StreamHub::Source &source)
+{
+    const QString stream = streamName(source);
+    if (!m_sources.contains(stream)) {
+        m_sources.insert(stream, source);
+    }
+}
+
+bool StreamServer::isWatched(const QString &stream) const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_watched.contains(stream);
+}
+
+void StreamServer::setHeader(const QString &stream, const QByteArray &header)
+{
+    emit headerChanged(stream, header);
+}
+
+void StreamServer::publish(const QString &stream, const AVPacket *pkt)
+{
+    // the only copy, viewers share it
+    const QByteArray data(reinterpret_cast<const char *>(pkt->data), pkt->size);
+    emit packetPublished(stream, data, pkt->flags & AV_PKT_FLAG_KEY);
+}
+
+void StreamServer::onNewConnection()
+{
+    while (m_server && m_server->hasPendingConnections()) {
+        QTcpSocket *socket = m_server->nextPendingConnection();
+        m_clients.insert(socket, Client());
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+        connect(socket, &QTcpSocket::bytesWritten, this, [this, socket]() { flush(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            removeClient(socket);
+        });
+    }
+}
+
+void StreamServer::onReadyRead(QTcpSocket *socket)
+{
+    auto it = m_clients.find(socket);
+    if (it == m_clients.end()) {
+        return;
+    }
+    Client &client = *it;
+    if (client.streaming) {
+        socket->readAll();
+        return;
+    }
+    client.request.append(socket->readAll());
+    int end = client.request.indexOf("\r\n\r\n");
+    if (end < 0) {
+        end = client.request.indexOf("\n\n");
+    }
+    if (end < 0) {
+        if (client.request.size() > maxRequestSize) {
+            socket->disconnectFromHost();
+        }
+        return;
+    }
+
+    const QByteArray requestLine = client.request.left(client.request.indexOf('\n'));
+    const QList<QByteArray> request = requestLine.simplified().split(' ');
+    if (request.size() < 2 || request.at(0) != "GET") {
+        socket->write("HTTP/1.0 405 Method Not Allowed\r\nConnection: close\r\n\r\n");
+        socket->disconnectFromHost();
+        return;
+    }
+    const QString stream = QUrl::fromPercentEncoding(request.at(1)).mid(1);
+    if (stream.isEmpty()) {
+        // what can be watched, one stream path per line
+        QStringList streams = m_sources.keys();
+        streams.sort();
+        const QByteArray body = streams.join('\n').toUtf8() + '\n';
+        socket->write("HTTP/1.0 200 OK\r\n"
+                      "Content-Type: text/plain\r\n"
+                      "Connection: close\r\n\r\n"
+                      + body);
+        socket->disconnectFromHost();
+    } else if (!m_sources.contains(stream)) {
+        socket->write("HTTP/1.0 404 Not Found\r\nConnection: close\r\n\r\n");
+        socket->disconnectFromHost();
+    } else {
+        startStreaming(socket, stream);
+    }
+}
+
+void StreamServer::startStreaming(QTcpSocket *socket, const QString &stream)
+{
+    Client &client = m_clients[socket];
+    client.stream = stream;
+    client.request.clear();
+    client.streaming = true;
+    client.waitingKeyframe = true;
+    socket->write("HTTP/1.0 200 OK\r\n"
+                  "Content-Type: video/h264\r\n"
+                  "Cache-Control: no-cache\r\n"
+                  "Connection: close\r\n\r\n");
+    qDebug() << "STREAMSERVER" << socket->peerAddress().toString() << "watches" << stream;
+    updateWatched();
+}
+
+void StreamServer::removeClient(QTcpSocket *socket)
+{
+    if (m_clients.remove(socket)) {
+        socket->deleteLater();
+        updateWatched();
+    }
+}
+
+void StreamServer::onHeaderChanged(const QString &stream, const QByteArray &header)
+{
+    m_headers.insert(stream, header);
+    // a restarted encoder, viewers go on at its first keyframe with the new parameters
+    for (Client &client : m_clients) {
+        if (client.stream == stream) {
+            client.waitingKeyframe = true;
+        }
+    }
+}
+
+void StreamServer::onPacketPublished(const QString &stream, const QByteArray &data, bool keyframe)
+{
+    for (auto it = m_clients.begin(); it != m_clients.end(); ++it) {
+        Client &client = it.value();
+        if (!client.streaming || client.stream != stream) {
+            continue;
+        }
+        if (client.queuedBytes > maxQueuedBytes) {
+            qDebug() << "STREAMSERVER" << it.key()->peerAddress().toString() << "fell behind on"
+                     << stream;
+            client.queue.clear();
+            client.queuedBytes = 0;
+            client.waitingKeyframe = true;
+        }
+        if (client.waitingKeyframe) {
+            if (!keyframe) {
+                continue;
+            }
+            client.waitingKeyframe = false;
+            // SPS and PPS, the device sends them only when the encoder starts
+            enqueue(client, m_headers.value(stream));
+        }
+        enqueue(client, data);
+        flush(it.key());
+    }
+}
+
+void StreamServer::enqueue(Client &client, const QByteArray &data)
+{
+    if (data.isEmpty()) {
+        return;
+    }
+    client.queue.push_back(data);
+    client.queuedBytes += data.size();
+}
+
+void StreamServer::flush(QTcpSocket *socket)
+{
+    auto it = m_clients.find(socket);
+    if (it == m_clients.end()) {
+        return;
+    }
+    Client &client = *it;
+    while (!client.queue.empty() && socket->bytesToWrite() < maxSocketBytes) {
+        const QByteArray &data = client.queue.front();
+        socket->write(data);
+        client.queuedBytes -= data.size();
+        client.queue.pop_front();
+    }
+}
+
+void StreamServer::updateWatched()
+{
+    QSet<QString> watched;
+    for (const Client &client : m_clients) {
+        if (client.streaming) {
+            watched.insert(client.stream);
+        }
+    }
+
+    // keyframes only and hardly any images, just so the stream runs
+    for (const QString &stream : watched) {
+        if (!m_sinks.contains(stream)) {
+            VideoSink *sink = StreamHub::instance()->subscribe(m_sources.value(stream));
+            sink->setImageScalePercent(10);
+            sink->setDecodeMode(VideoThread::DecodeKeyframes);
+            sink->setImageRate(VideoSink::heartbeatRate());
+            m_sinks.insert(stream, sink);
+        }
+    }
+    for (const QString &stream : m_sinks.keys()) {
+        if (!watched.contains(stream)) {
+            StreamHub::instance()->unsubscribe(m_sinks.take(stream));
+        }
+    }
+
+    QMutexLocker lock(&m_mutex);
+    m_watched = watched;
+}
@@ -0,0 +1,84 @@
+#ifndef STREAMSERVER_H
+#define STREAMSERVER_H
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <deque>
+#include "streamhub.h"
+
+class QTcpServer;
+class QTcpSocket;
+class VideoSink;
+struct AVPacket;
+
+// Serves the H.264 streams of devices as they come from the device, without
+// decoding or encoding, to any number of viewers over HTTP:
+//   ffplay -f h264 http://host:port/<adb host>:<adb port>/<device id>
+// Streams are named after the adb server and the device, as devices of
+// different servers may have the same id.
+// Every packet is copied once into a shared buffer that all viewers queue.
+// A viewer that falls behind has its queue dropped and resumes at the next
+// keyframe. While anyone watches, the device's stream is kept running.
+class StreamServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    static StreamServer *instance();
+
+    // 0 stops listening
+    bool listen(int port);
+    int port() const;
+
+    // devices that can be watched, called for every stream the hub starts
+    void addSource(const StreamHub::Source &source);
+
+    // called from the stream's thread with "<adb host>:<adb port>/<device id>"
+    bool isWatched(const QString &stream) const;
+    void setHeader(const QString &stream, const QByteArray &header);
+    void publish(const QString &stream, const AVPacket *pkt);
+
+signals:
+    void packetPublished(const QString &stream, const QByteArray &data, bool keyframe);
+    void headerChanged(const QString &stream, const QByteArray &header);
+
+private slots:
+    void onNewConnection();
+    void onPacketPublished(const QString &stream, const QByteArray &data, bool keyframe);
+    void onHeaderChanged(const QString &stream, const QByteArray &header);
+
+private:
+    struct Client
+    {
+        QString stream{};
+        QByteArray request{};
+        bool streaming{};
+        bool waitingKeyframe{true};
+        std::deque<QByteArray> queue{};
+        qint64 queuedBytes{};
+    };
+
+    explicit StreamServer(QObject *parent = nullptr);
+
+    static QString streamName(const StreamHub::Source &source);
+    void onReadyRead(QTcpSocket *socket);
+    void startStreaming(QTcpSocket *socket, const QString &stream);
+    void removeClient(QTcpSocket *socket);
+    static void enqueue(Client &client, const QByteArray &data);
+    void flush(QTcpSocket *socket);
+    void updateWatched();
+
+    QTcpServer *m_server{};
+    QHash<QTcpSocket *, Client> m_clients{};
+    QHash<QString, StreamHub::Source> m_sources{};
+    QHash<QString, QByteArray> m_headers{};
+    // keeps watched streams running when nothing else shows them
+    QHash<QString, VideoSink *> m_sinks{};
+
+    mutable QMutex m_mutex{};
+    QSet<QString> m_watched{};
+};
+
+#endif // STREAMSERVER_H
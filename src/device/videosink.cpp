@@ -0,0 +1,130 @@
+/*
+   DivvyDroid - Application to screencast and remote control Android devices.
+
+   Copyright (C) 2019 - Mladen Milinkovic <maxrd2@smoothware.net>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "videosink.h"
+
+// a covered sink still gets a frame this often, so it isn't stale once uncovered
+static const unsigned long heartbeatMs = 5000;
+
+VideoSink::VideoSink(QObject *parent)
+    : QObject(parent)
+{}
+
+VideoSink::~VideoSink() {}
+
+void VideoSink::setImageScalePercent(double p)
+{
+    m_imageScale = p / 100.0;
+}
+
+void VideoSink::setImageRate(double fps)
+{
+    m_imageRateMs = 1000 / fps;
+    emit settingsChanged();
+}
+
+double VideoSink::imageRate() const
+{
+    return 1000.0 / qMax<unsigned long>(1, m_imageRateMs);
+}
+
+void VideoSink::setTargetSize(const QSize &size)
+{
+    if (size.isEmpty()) {
+        m_targetSize = 0;
+    } else {
+        m_targetSize = (quint64(size.width()) << 32) | quint64(size.height());
+    }
+}
+
+void VideoSink::setDecodeMode(VideoThread::DecodeMode mode)
+{
+    m_decodeMode = mode;
+    emit settingsChanged();
+}
+
+VideoThread::DecodeMode VideoSink::decodeMode() const
+{
+    return VideoThread::DecodeMode(m_decodeMode.load());
+}
+
+void VideoSink::setWeight(int weight)
+{
+    m_weight = weight;
+    emit settingsChanged();
+}
+
+int VideoSink::weight() const
+{
+    return m_weight;
+}
+
+void VideoSink::setVisibility(Visibility visibility)
+{
+    if (m_visibility == visibility) {
+        return;
+    }
+    m_visibility = visibility;
+    emit settingsChanged();
+}
+
+VideoSink::Visibility VideoSink::visibility() const
+{
+    return Visibility(m_visibility.load());
+}
+
+double VideoSink::heartbeatRate()
+{
+    return 1000.0 / heartbeatMs;
+}
+
+VideoThread *VideoSink::videoThread() const
+{
+    return m_thread;
+}
+
+QSize VideoSink::outputSize(const QSize &frameSize) const
+{
+    const quint64 target = m_targetSize;
+    const QSize targetSize(int(target >> 32), int(target & 0xffffffff));
+    if (targetSize.isEmpty() || frameSize.isEmpty()) {
+        const double scale = m_imageScale;
+        // rounded like QSize * qreal, so views can tell the scale from the size
+        return QSize(qMax(1, qRound(frameSize.width() * scale)),
+                     qMax(1, qRound(frameSize.height() * scale)));
+    }
+    // fit the frame into the widget that displays it
+    return frameSize.scaled(targetSize, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+}
+
+bool VideoSink::isFrameDue()
+{
+    const int visibility = m_visibility;
+    if (visibility == Hidden) {
+        return false;
+    }
+    if (visibility == Visible && m_decodeMode == VideoThread::DecodeFull) {
+        return true;
+    }
+    const unsigned long intervalMs = visibility == Covered ? heartbeatMs : m_imageRateMs.load();
+    if (m_frameTimer.isValid() && m_frameTimer.elapsed() < qint64(intervalMs)) {
+        return false;
+    }
+    m_frameTimer.start();
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef VIDEOSINK_H
+#define VIDEOSINK_H
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QSize>
+#include <atomic>
+#include "videothread.h"
+
+// One consumer of a device's video: a grid cell, a detail window... Every
+// sink asks for its own output size and frame rate, the stream it is
+// subscribed to converts each decoded frame once per distinct size.
+class VideoSink : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Covered sinks, scrolled away or behind other windows, get a heartbeat
+    // frame now and then, Hidden ones, in a minimized window, get nothing
+    enum Visibility { Visible, Covered, Hidden };
+
+    explicit VideoSink(QObject *parent = nullptr);
+    ~VideoSink();
+
+    void setImageScalePercent(double p);
+    void setImageRate(double fps);
+    double imageRate() const;
+    // fit frames into this size keeping aspect ratio, an empty size uses the scale
+    void setTargetSize(const QSize &size);
+    void setDecodeMode(VideoThread::DecodeMode mode);
+    VideoThread::DecodeMode decodeMode() const;
+    void setWeight(int weight);
+    int weight() const;
+    void setVisibility(Visibility visibility);
+    Visibility visibility() const;
+
+    static double heartbeatRate();
+
+    VideoThread *videoThread() const;
+
+    // called from the stream's producing thread
+    QSize outputSize(const QSize &frameSize) const;
+    bool isFrameDue();
+
+signals:
+    void imageReady(const QImage &image);
+    void statsReady(const VideoStats &stats);
+    void frameSizeChanged(const QSize &size, int rotation);
+    // something the shared stream is configured from has changed
+    void settingsChanged();
+
+private:
+    friend class StreamHub;
+
+    QPointer<VideoThread> m_thread{};
+    std::atomic<double> m_imageScale{1.0};
+    // width in high, height in low 32 bits, so producer never sees half an update
+    std::atomic<quint64> m_targetSize{0};
+    std::atomic<unsigned long> m_imageRateMs{100};
+    std::atomic<int> m_decodeMode{VideoThread::DecodeFull};
+    std::atomic<int> m_weight{1};
+    std::atomic<int> m_visibility{Visible};
+    QElapsedTimer m_frameTimer{};
+};
+
+#endif // VIDEOSINK_H
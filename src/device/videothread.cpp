@@ -1,10 +1,18 @@
 #include "videothread.h"
+#include <QDebug>
+#include <QElapsedTimer>
 #include <QImage>
+#include <QVector>
+#include <algorithm>
 #include "adbclient.h"
+#include "startupscheduler.h"
+#include "videosink.h"
 
 VideoThread::VideoThread(QObject *parent)
     : QThread(parent)
-{}
+{
+    qRegisterMetaType<VideoStats>();
+}
 
 VideoThread::~VideoThread()
 {
@@ -17,9 +25,14 @@ void VideoThread::run()
     m_adb = new AdbClient();
     m_adb->setHost(m_host, m_port);
     m_adb->setDevice(m_deviceId);
-    m_devInfo = m_adb->getDeviceInfo();
+    if (beginStartup()) {
+        m_devInfo = m_adb->getDeviceInfo();
+        m_screenRotation = m_devInfo.screenRotation % 360;
+        m_frameSize = 0;
 
-    loop();
+        loop();
+    }
+    endStartup();
 
     m_adb->disconnectFromHost();
     m_adb->waitForDisconnected();
@@ -31,8 +44,13 @@ void VideoThread::run()
 void VideoThread::loop()
 {
     while (!isInterruptionRequested()) {
+        if (m_suspended) {
+            msleep(50);
+            continue;
+        }
         QImage img;
-        if (m_adb->devIsScreenAwake()) {
+        const bool awake = m_adb->devIsScreenAwake();
+        if (awake) {
             if (m_imageFormat == ImageRaw) {
                 img = m_adb->fetchScreenRaw();
             } else if (m_imageFormat == ImageJpg) {
@@ -46,10 +64,27 @@ void VideoThread::loop()
             img = QImage(320, 240, QImage::Format_RGB888);
             img.fill(Qt::black);
         }
+        // the first grab is the expensive one
+        endStartup();
         if (!img.isNull()) {
-            emit imageReady(img.scaledToWidth(getScaledSize(img.width()), Qt::FastTransformation));
+            if (awake) {
+                // a rotated screen comes with swapped framebuffer dimensions
+                updateFrameSize(img.size());
+            }
+            const Qt::TransformationMode mode = scaleFilter() == ScaleFastBilinear
+                                                    ? Qt::FastTransformation
+                                                    : Qt::SmoothTransformation;
+            publishFrame(img.size(), [&img, mode](const QSize &size) {
+                return img.scaled(size, Qt::IgnoreAspectRatio, mode);
+            });
+        }
+        // a long heartbeat wait ends as soon as a faster rate is set
+        QElapsedTimer waitTimer;
+        waitTimer.start();
+        while (!isInterruptionRequested() && !m_suspended
+               && waitTimer.elapsed() < qint64(m_imageRateMs)) {
+            msleep(qMin<unsigned long>(50, m_imageRateMs));
         }
-        msleep(m_imageRateMs);
     }
 }
 
@@ -69,24 +104,137 @@ void VideoThread::setImageFormat(ImageFormat format)
     m_imageFormat = format;
 }
 
-void VideoThread::setImageScale(double scale)
+void VideoThread::setImageRate(double fps)
 {
-    m_imageScale = scale;
+    m_imageRateMs = 1000 / fps;
 }
 
-void VideoThread::setImageScalePercent(double p)
+void VideoThread::setDecodeMode(DecodeMode mode)
 {
-    m_imageScale = p / 100.0;
+    m_decodeMode = mode;
 }
 
-void VideoThread::setImageRate(double fps)
+VideoThread::DecodeMode VideoThread::decodeMode() const
 {
-    m_imageRateMs = 1000 / fps;
+    return DecodeMode(m_decodeMode.load());
 }
 
-int VideoThread::getScaledSize(int value) const
+void VideoThread::setDecodeWeight(int weight)
 {
-    return int(double(value) * m_imageScale);
+    m_decodeWeight = weight;
+}
+
+int VideoThread::decodeWeight() const
+{
+    return m_decodeWeight;
+}
+
+void VideoThread::setScaleFilter(ScaleFilter filter)
+{
+    m_scaleFilter = filter;
+}
+
+VideoThread::ScaleFilter VideoThread::scaleFilter() const
+{
+    return ScaleFilter(m_scaleFilter.load());
+}
+
+void VideoThread::setScaleThreads(int threads)
+{
+    m_scaleThreads = threads;
+}
+
+int VideoThread::scaleThreads() const
+{
+    return m_scaleThreads;
+}
+
+void VideoThread::setSuspended(bool suspended)
+{
+    m_suspended = suspended;
+}
+
+bool VideoThread::isSuspended() const
+{
+    return m_suspended && !needsStream();
+}
+
+bool VideoThread::needsStream() const
+{
+    return false;
+}
+
+void VideoThread::addSink(VideoSink *sink)
+{
+    QMutexLocker lock(&m_sinkMutex);
+    m_sinks.append(sink);
+}
+
+void VideoThread::removeSink(VideoSink *sink)
+{
+    // waits for a frame being published to it
+    QMutexLocker lock(&m_sinkMutex);
+    m_sinks.removeAll(sink);
+}
+
+QSize VideoThread::frameSize() const
+{
+    const quint64 size = m_frameSize;
+    return QSize(int(size >> 32), int(size & 0xffffffff));
+}
+
+int VideoThread::screenRotation() const
+{
+    return m_screenRotation;
+}
+
+int VideoThread::startupPriority() const
+{
+    QMutexLocker lock(&m_sinkMutex);
+    int priority = 0;
+    for (const VideoSink *sink : m_sinks) {
+        switch (sink->visibility()) {
+        case VideoSink::Visible:
+            priority = qMax(priority, 2);
+            break;
+        case VideoSink::Covered:
+            priority = qMax(priority, 1);
+            break;
+        default:
+            break;
+        }
+    }
+    return priority;
+}
+
+bool VideoThread::beginStartup()
+{
+    if (m_startupHeld) {
+        return true;
+    }
+    if (!StartupScheduler::instance()->acquire(this)) {
+        return false;
+    }
+    m_startupHeld = true;
+    return true;
+}
+
+void VideoThread::endStartup()
+{
+    // called from decode workers as well
+    if (m_startupHeld.exchange(false)) {
+        StartupScheduler::instance()->release(this);
+    }
+}
+
+QString VideoThread::host() const
+{
+    return m_host;
+}
+
+QString VideoThread::server() const
+{
+    return QString("%1:%2").arg(m_host).arg(m_port);
 }
 
 AdbClient *VideoThread::adb() const
@@ -98,3 +246,55 @@ const DeviceInfo &VideoThread::devInfo() const
 {
     return m_devInfo;
 }
+
+bool VideoThread::publishFrame(const QSize &frameSize,
+                               const std::function<QImage(const QSize &)> &convert)
+{
+    QMutexLocker lock(&m_sinkMutex);
+    // sinks that want the same size share one converted image
+    QVector<QPair<QSize, QImage>> images;
+    for (VideoSink *sink : m_sinks) {
+        if (!sink->isFrameDue()) {
+            continue;
+        }
+        const QSize size = sink->outputSize(frameSize);
+        auto it = std::find_if(images.begin(), images.end(), [&size](const QPair<QSize, QImage> &i) {
+            return i.first == size;
+        });
+        if (it == images.end()) {
+            images.append(qMakePair(size, convert(size)));
+            it = images.end() - 1;
+        }
+        if (!it->second.isNull()) {
+            emit sink->imageReady(it->second);
+        }
+    }
+    return !images.isEmpty();
+}
+
+bool VideoThread::updateFrameSize(const QSize &size)
+{
+    const quint64 packed = (quint64(size.width()) << 32) | quint64(size.height());
+    const quint64 previous = m_frameSize.exchange(packed);
+    if (previous == packed) {
+        return false;
+    }
+
+    // frames are in display orientation, compare them with the panel's natural one
+    int naturalWidth = m_devInfo.ovScreenWidth ? m_devInfo.ovScreenWidth : m_devInfo.phScreenWidth;
+    int naturalHeight = m_devInfo.ovScreenWidth ? m_devInfo.ovScreenHeight
+                                                : m_devInfo.phScreenHeight;
+    int rotation = m_devInfo.screenRotation % 360;
+    if (naturalWidth && naturalHeight
+        && (naturalWidth > naturalHeight) != (size.width() > size.height())) {
+        rotation = (rotation + 90) % 360;
+    }
+    m_screenRotation = rotation;
+
+    if (previous) {
+        qDebug() << "FRAMEBUFFER" << m_devInfo.deviceId << "frame size changed to" << size
+                 << "rotation" << rotation;
+    }
+    emit frameSizeChanged(size, rotation);
+    return true;
+}
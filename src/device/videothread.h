@@ -1,10 +1,32 @@
 #ifndef VIDEOTHREAD_H
 #define VIDEOTHREAD_H
+#include <QList>
+#include <QMetaType>
+#include <QMutex>
+#include <QSize>
 #include <QThread>
+#include <atomic>
+#include <functional>
 #include "device/adbclient.h"
 
 class AdbClient;
 class AdbDeviceInfo;
+class VideoSink;
+
+struct VideoStats
+{
+    double fps{};
+    int queueDepth{};
+    double decodeMs{};
+    int droppedPackets{};
+    QString scaler{};
+    // capture to arrival lag over the best seen, -1 when the source has no timestamps
+    double latencyMs{-1};
+    double ingressKbps{};
+    // bitrate the device encoder was asked for, 0 when it isn't controlled
+    int bitRateKbps{};
+};
+Q_DECLARE_METATYPE(VideoStats)
 
 class VideoThread : public QThread
 {
@@ -12,6 +34,11 @@ class VideoThread : public QThread
 
 public:
     enum ImageFormat { ImageRaw, ImageJpg, ImagePng };
+    // DecodeThumbnail decodes every frame but converts/emits only at image rate,
+    // DecodeKeyframes additionally makes the decoder drop everything but keyframes
+    enum DecodeMode { DecodeFull, DecodeThumbnail, DecodeKeyframes };
+    // ScaleAuto picks the filter from the downscale ratio
+    enum ScaleFilter { ScaleAuto, ScaleFastBilinear, ScaleArea, ScaleBicubic };
 
     VideoThread(QObject *parent = nullptr);
     virtual ~VideoThread();
@@ -19,18 +46,45 @@ public:
     void setHost(const QString &host, int port);
     void setDevice(const QString &deviceId);
     void setImageFormat(ImageFormat mode);
-    void setImageScale(double scale);
-    void setImageScalePercent(double p);
     void setImageRate(double fps);
+    void setDecodeMode(DecodeMode mode);
+    DecodeMode decodeMode() const;
+    void setDecodeWeight(int weight);
+    int decodeWeight() const;
+    void setScaleFilter(ScaleFilter filter);
+    ScaleFilter scaleFilter() const;
+    void setScaleThreads(int threads);
+    int scaleThreads() const;
+    // nobody can see the stream, stop capturing until it is resumed, unless
+    // the stream is needed without being seen
+    void setSuspended(bool suspended);
+    bool isSuspended() const;
+
+    void addSink(VideoSink *sink);
+    void removeSink(VideoSink *sink);
 
-    int getScaledSize(int value) const;
+    QSize frameSize() const;
+    int screenRotation() const;
+    // visible streams connect first
+    int startupPriority() const;
+    // "host:port" of the adb server the device is on
+    QString server() const;
 
 signals:
-    void imageReady(const QImage &image);
+    void frameSizeChanged(const QSize &size, int rotation);
+    void statsReady(const VideoStats &stats);
 
 protected:
     AdbClient *adb() const;
+    QString host() const;
     const DeviceInfo &devInfo() const;
+    bool publishFrame(const QSize &frameSize, const std::function<QImage(const QSize &)> &convert);
+    bool updateFrameSize(const QSize &size);
+    // the stream keeps running while suspended, e.g. to be recorded
+    virtual bool needsStream() const;
+    // a connect slot is held from beginStartup() until the first frame
+    bool beginStartup();
+    void endStartup();
 
 private:
     virtual void run();
@@ -40,8 +94,18 @@ private:
     int m_port{5037};
     QString m_deviceId{};
     ImageFormat m_imageFormat{ImageRaw};
-    double m_imageScale{1.0};
-    unsigned long m_imageRateMs{100};
+    std::atomic<unsigned long> m_imageRateMs{100};
+    std::atomic<int> m_decodeMode{DecodeFull};
+    std::atomic<int> m_decodeWeight{1};
+    std::atomic<int> m_scaleFilter{ScaleAuto};
+    std::atomic<int> m_scaleThreads{1};
+    std::atomic<bool> m_suspended{false};
+    std::atomic<bool> m_startupHeld{false};
+    mutable QMutex m_sinkMutex{};
+    QList<VideoSink *> m_sinks{};
+    // full size of the frames the device sends, changes when the screen rotates
+    std::atomic<quint64> m_frameSize{0};
+    std::atomic<int> m_screenRotation{0};
 
     AdbClient *m_adb{};
     DeviceInfo m_devInfo{};
@@ -0,0 +1,52 @@
+#include "displayclock.h"
+#include <QGuiApplication>
+#include <QScreen>
+
+DisplayClock::DisplayClock(QObject *parent)
+    : QObject(parent)
+{
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &DisplayClock::onTimeout);
+    setRate(0);
+}
+
+DisplayClock *DisplayClock::instance()
+{
+    static DisplayClock clock;
+    return &clock;
+}
+
+void DisplayClock::setRate(double hz)
+{
+    m_rate = hz;
+    double rate = hz;
+    if (rate <= 0) {
+        QScreen *screen = QGuiApplication::primaryScreen();
+        rate = screen && screen->refreshRate() > 0 ? screen->refreshRate() : 60;
+    }
+    m_timer.setInterval(qMax(1, int(1000 / rate)));
+}
+
+double DisplayClock::rate() const
+{
+    return m_rate;
+}
+
+void DisplayClock::frameArrived()
+{
+    m_pending = true;
+    if (!m_timer.isActive()) {
+        m_timer.start();
+    }
+}
+
+void DisplayClock::onTimeout()
+{
+    if (!m_pending) {
+        // nothing came in for a whole tick
+        m_timer.stop();
+        return;
+    }
+    m_pending = false;
+    emit tick();
+}
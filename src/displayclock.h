@@ -0,0 +1,38 @@
+#ifndef DISPLAYCLOCK_H
+#define DISPLAYCLOCK_H
+#include <QObject>
+#include <QTimer>
+
+// Paces repaints of all views: frames arriving between two ticks only
+// replace the pending one, and at the tick every view with a new frame is
+// updated at once. The clock runs at the screen's refresh rate unless a rate
+// is set, and stops while no frames arrive.
+class DisplayClock : public QObject
+{
+    Q_OBJECT
+
+public:
+    static DisplayClock *instance();
+
+    // 0 follows the primary screen
+    void setRate(double hz);
+    double rate() const;
+
+    // a view has a new frame waiting for the next tick
+    void frameArrived();
+
+signals:
+    void tick();
+
+private slots:
+    void onTimeout();
+
+private:
+    explicit DisplayClock(QObject *parent = nullptr);
+
+    double m_rate{};
+    bool m_pending{};
+    QTimer m_timer{};
+};
+
+#endif // DISPLAYCLOCK_H
@@ -0,0 +1,237 @@
+#include "gridsurface.h"
+#include <QMouseEvent>
+#include <QPainter>
+#include "cellsession.h"
+#include "input/shellinput.h"
+
+static const int cellSpacing = 4;
+
+GridSurface::GridSurface(QWidget *parent)
+    : QWidget(parent)
+{
+    // every pixel is painted here, nothing behind needs repainting
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setMouseTracking(true);
+    setFocusPolicy(Qt::StrongFocus);
+    m_labelHeight = fontMetrics().height() + 4;
+}
+
+GridSurface::~GridSurface() {}
+
+void GridSurface::setSessions(const std::vector<CellSession *> &sessions, int rows, int cols)
+{
+    for (CellSession *session : m_sessions) {
+        session->disconnect(this);
+    }
+    qDeleteAll(m_inputs);
+    m_inputs.clear();
+    m_hovered = -1;
+    m_pressed = -1;
+
+    m_sessions = sessions;
+    m_rows = qMax(1, rows);
+    m_cols = qMax(1, cols);
+    for (int i = 0; i != int(m_sessions.size()); ++i) {
+        CellSession *session = m_sessions[i];
+        connect(session, &CellSession::imageChanged, this, [this, i]() { update(frameArea(i)); });
+        connect(session, &CellSession::statsChanged, this, [this, i]() { update(labelRect(i)); });
+        connect(session, &CellSession::runningChanged, this, [this, i]() { update(cellRect(i)); });
+        connect(session, &CellSession::deviceChanged, this, [this, i, session]() {
+            delete m_inputs.take(session);
+            update(cellRect(i));
+        });
+    }
+    updateTargetSizes();
+    update();
+}
+
+int GridSurface::cellAt(const QPoint &pos) const
+{
+    for (int i = 0; i != int(m_sessions.size()); ++i) {
+        if (cellRect(i).contains(pos)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+QRect GridSurface::cellRect(int index) const
+{
+    const int w = (width() - cellSpacing * (m_cols + 1)) / m_cols;
+    const int h = (height() - cellSpacing * (m_rows + 1)) / m_rows;
+    const int row = index / m_cols;
+    const int col = index % m_cols;
+    return QRect(cellSpacing + col * (w + cellSpacing), cellSpacing + row * (h + cellSpacing), w, h);
+}
+
+QRect GridSurface::labelRect(int index) const
+{
+    QRect rect = cellRect(index);
+    rect.setHeight(m_labelHeight);
+    return rect;
+}
+
+QRect GridSurface::frameArea(int index) const
+{
+    return cellRect(index).adjusted(0, m_labelHeight, 0, 0);
+}
+
+QRect GridSurface::imageRect(int index) const
+{
+    // frames of the focused cell are drawn 1:1, the sinks already scaled them to what fits
+    const QImage &image = m_sessions[index]->image();
+    // lower tiers send smaller frames, they are stretched back to the cell's size
+    const qreal ratio = (m_sessions[index]->conf().fit ? devicePixelRatioF() : 1.0)
+                        * m_sessions[index]->imageScale();
+    QRect rect(QPoint(), image.size() / ratio);
+    rect.moveCenter(frameArea(index).center());
+    return rect;
+}
+
+void GridSurface::updateTargetSizes()
+{
+    for (int i = 0; i != int(m_sessions.size()); ++i) {
+        CellSession *session = m_sessions[i];
+        session->setTargetSize(session->conf().fit ? frameArea(i).size() * devicePixelRatioF()
+                                                   : QSize());
+    }
+}
+
+void GridSurface::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+    painter.fillRect(event->rect(), palette().window());
+    for (int i = 0; i != int(m_sessions.size()); ++i) {
+        if (event->region().intersects(cellRect(i))) {
+            paintCell(painter, i);
+        }
+    }
+}
+
+void GridSurface::paintCell(QPainter &painter, int index)
+{
+    const CellSession *session = m_sessions[index];
+    const QRect area = frameArea(index);
+    painter.save();
+    painter.setClipRect(cellRect(index));
+
+    painter.fillRect(area, Qt::black);
+    if (!session->image().isNull()) {
+        painter.drawImage(imageRect(index), session->image());
+        if (session->isStale()) {
+            painter.fillRect(area, QColor(0, 0, 0, 128));
+        }
+    }
+
+    const QRect label = labelRect(index);
+    painter.fillRect(label, index == m_hovered ? palette().highlight() : palette().mid());
+    painter.setPen(index == m_hovered ? palette().highlightedText().color()
+                                      : palette().windowText().color());
+    const QRect text = label.adjusted(4, 0, -4, 0);
+    painter.drawText(text, Qt::AlignLeft | Qt::AlignVCenter, session->deviceId());
+    painter.drawText(text, Qt::AlignRight | Qt::AlignVCenter, session->status());
+    painter.restore();
+}
+
+void GridSurface::resizeEvent(QResizeEvent *event)
+{
+    updateTargetSizes();
+    QWidget::resizeEvent(event);
+}
+
+void GridSurface::setHovered(int index)
+{
+    if (m_hovered == index) {
+        return;
+    }
+    if (m_hovered >= 0) {
+        m_sessions[m_hovered]->setFocused(false);
+        update(labelRect(m_hovered));
+    }
+    m_hovered = index;
+    if (m_hovered >= 0) {
+        m_sessions[m_hovered]->setFocused(true);
+        update(labelRect(m_hovered));
+    }
+}
+
+ShellInput *GridSurface::input(int index)
+{
+    CellSession *session = m_sessions[index];
+    if (!session->isRunning()) {
+        return nullptr;
+    }
+    ShellInput *&input = m_inputs[session];
+    if (!input) {
+        input = new ShellInput(session->source(), this);
+    }
+    return input;
+}
+
+void GridSurface::mouseMoveEvent(QMouseEvent *event)
+{
+    if (m_pressed < 0) {
+        setHovered(cellAt(event->pos()));
+    }
+    QWidget::mouseMoveEvent(event);
+}
+
+void GridSurface::mousePressEvent(QMouseEvent *event)
+{
+    const int index = cellAt(event->pos());
+    if (event->button() == Qt::LeftButton && index >= 0 && imageRect(index).contains(event->pos())) {
+        if (ShellInput *shellInput = input(index)) {
+            m_pressed = index;
+            m_sessions[index]->noteInteraction();
+            shellInput->press(event->pos() - imageRect(index).topLeft());
+            return;
+        }
+    }
+    QWidget::mousePressEvent(event);
+}
+
+void GridSurface::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton && m_pressed >= 0) {
+        const QRect rect = imageRect(m_pressed);
+        if (ShellInput *shellInput = input(m_pressed)) {
+            // a swipe may end outside of the frame, keep it on the screen's edge
+            const QPoint pos(qBound(0, event->pos().x() - rect.left(), rect.width() - 1),
+                             qBound(0, event->pos().y() - rect.top(), rect.height() - 1));
+            shellInput->release(pos, rect.size(), m_sessions[m_pressed]->frameSize());
+        }
+        m_pressed = -1;
+        setHovered(cellAt(event->pos()));
+        return;
+    }
+    QWidget::mouseReleaseEvent(event);
+}
+
+void GridSurface::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    const int index = cellAt(event->pos());
+    if (index >= 0 && labelRect(index).contains(event->pos()) && m_sessions[index]->isRunning()) {
+        emit detailRequested(m_sessions[index]);
+        return;
+    }
+    // the second press of a double tap
+    mousePressEvent(event);
+}
+
+void GridSurface::keyPressEvent(QKeyEvent *event)
+{
+    ShellInput *shellInput = m_hovered >= 0 ? input(m_hovered) : nullptr;
+    if (!shellInput || !shellInput->key(event)) {
+        QWidget::keyPressEvent(event);
+        return;
+    }
+    m_sessions[m_hovered]->noteInteraction();
+}
+
+void GridSurface::leaveEvent(QEvent *event)
+{
+    if (m_pressed < 0) {
+        setHovered(-1);
+    }
+    QWidget::leaveEvent(event);
+}
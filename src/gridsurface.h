@@ -0,0 +1,57 @@
+#ifndef GRIDSURFACE_H
+#define GRIDSURFACE_H
+#include <QHash>
+#include <QWidget>
+#include <vector>
+class CellSession;
+class ShellInput;
+
+// Draws the frames of all cell sessions on one widget, each cell gets a
+// label strip with the device id and rate over its frame. Clicks and drags
+// on a frame go to the device as taps and swipes, keys go to the device
+// under the mouse, a double-click on a label opens the detail window.
+class GridSurface : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit GridSurface(QWidget *parent = nullptr);
+    ~GridSurface();
+
+    void setSessions(const std::vector<CellSession *> &sessions, int rows, int cols);
+
+    int cellAt(const QPoint &pos) const;
+    QRect cellRect(int index) const;
+
+signals:
+    void detailRequested(CellSession *session);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void leaveEvent(QEvent *event) override;
+
+private:
+    QRect labelRect(int index) const;
+    QRect frameArea(int index) const;
+    QRect imageRect(int index) const;
+    void paintCell(QPainter &painter, int index);
+    void setHovered(int index);
+    void updateTargetSizes();
+    ShellInput *input(int index);
+
+    std::vector<CellSession *> m_sessions{};
+    int m_rows{1};
+    int m_cols{1};
+    int m_labelHeight{};
+    int m_hovered{-1};
+    int m_pressed{-1};
+    QHash<CellSession *, ShellInput *> m_inputs{};
+};
+
+#endif // GRIDSURFACE_H
@@ -1,16 +1,33 @@
 #include "gridwidget.h"
 #include <QDebug>
+#include <QEvent>
 #include <QGridLayout>
 #include <QLabel>
+#include <QScrollArea>
+#include <QScrollBar>
+#include <QWindow>
 #include "cellwidget.h"
-#include "device/adbclient.h"
+#include "detailwindow.h"
+#include "gridsurface.h"
+
+// occlusion and scrolling don't come with events we can rely on, poll them
+static const int visibilityIntervalMs = 500;
+// cells this many pages off the view still stream, so scrolling a bit shows live video
+static const int streamAheadPages = 1;
+// and cells further than this stop, in between they keep what they are doing
+static const int streamKeepPages = 2;
 
 GridWidget::GridWidget(QWidget *parent)
 {
     setLayout(new QVBoxLayout());
+    connect(&m_visibilityTimer, &QTimer::timeout, this, &GridWidget::updateVisibility);
+    m_visibilityTimer.start(visibilityIntervalMs);
 }
 
-GridWidget::~GridWidget() {}
+GridWidget::~GridWidget()
+{
+    closeDetails();
+}
 
 void GridWidget::init(const CellWidgetConf &conf)
 {
@@ -18,52 +35,343 @@ void GridWidget::init(const CellWidgetConf &conf)
 
     free();
 
-    m_gridLayout = new QGridLayout();
-    for (int i{}; i != m_cellConf.rows; ++i) {
-        for (int j{}; j != m_cellConf.cols; ++j) {
-            auto cell{new CellWidget(this)};
-            cell->setConf(m_cellConf);
-            m_gridLayout->addWidget(cell, i, j);
-            m_cellWidgets.push_back(cell);
-        }
+    m_scrollArea = new QScrollArea();
+    m_scrollArea->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    m_scrollArea->setFrameShape(QFrame::NoFrame);
+    m_scrollArea->viewport()->installEventFilter(this);
+    connect(m_scrollArea->verticalScrollBar(), &QScrollBar::valueChanged, this, [this]() {
+        updateVisibility();
+        updateStreams();
+    });
+
+    if (m_cellConf.surface) {
+        // one widget painting every cell, no widgets per cell
+        m_surface = new GridSurface();
+        connect(m_surface, &GridSurface::detailRequested, this, &GridWidget::openDetail);
+        m_mainWidget = m_surface;
+    } else {
+        m_gridLayout = new QGridLayout();
+        m_mainWidget = new QWidget();
+        m_mainWidget->setLayout(m_gridLayout);
     }
-    m_mainWidget = new QWidget();
-    m_mainWidget->setLayout(m_gridLayout);
-    layout()->addWidget(m_mainWidget);
+    m_scrollArea->setWidget(m_mainWidget);
+    layout()->addWidget(m_scrollArea);
+
+    setCellCount(m_cellConf.rows * m_cellConf.cols);
 }
 
 void GridWidget::free()
 {
-    if (m_mainWidget) {
-        layout()->removeWidget(m_mainWidget);
-        m_mainWidget->deleteLater();
-        m_gridLayout->deleteLater();
-        for (auto &w : m_cellWidgets) {
-            w->deleteLater();
-        }
+    stopTrackers();
+    closeDetails();
+    if (m_scrollArea) {
+        // takes the cells with it
+        layout()->removeWidget(m_scrollArea);
+        m_scrollArea->deleteLater();
         m_cellWidgets.clear();
+        m_scrollArea = nullptr;
+        m_mainWidget = nullptr;
+        m_gridLayout = nullptr;
+        m_surface = nullptr;
+    }
+    for (auto session : m_sessions) {
+        session->stop();
+        session->deleteLater();
+    }
+    m_sessions.clear();
+    m_started = false;
+}
+
+void GridWidget::setCellCount(int count)
+{
+    // whole rows only
+    const int cols = qMax(1, m_cellConf.cols);
+    count = (count + cols - 1) / cols * cols;
+    for (int i = int(m_sessions.size()); i < count; ++i) {
+        auto session{new CellSession(this)};
+        session->setConf(m_cellConf);
+        m_sessions.push_back(session);
+        if (m_gridLayout) {
+            auto cell{new CellWidget(session, m_mainWidget)};
+            connect(cell, &CellWidget::detailRequested, this, &GridWidget::openDetail);
+            m_gridLayout->addWidget(cell, i / cols, i % cols);
+            m_cellWidgets.push_back(cell);
+        }
+    }
+    if (m_surface) {
+        m_surface->setSessions(m_sessions, rowCount(), cols);
+    }
+    updateContentSize();
+}
+
+int GridWidget::rowCount() const
+{
+    const int cols = qMax(1, m_cellConf.cols);
+    return qMax(m_cellConf.rows, (int(m_sessions.size()) + cols - 1) / cols);
+}
+
+int GridWidget::rowHeight() const
+{
+    if (!m_scrollArea) {
+        return 0;
+    }
+    return m_scrollArea->viewport()->height() / qMax(1, m_cellConf.rows);
+}
+
+void GridWidget::updateContentSize()
+{
+    if (!m_scrollArea) {
+        return;
     }
+    // rows x cols cells fill the view, the rest is scrolled to
+    m_scrollArea->setVerticalScrollBarPolicy(rowCount() > m_cellConf.rows ? Qt::ScrollBarAlwaysOn
+                                                                          : Qt::ScrollBarAlwaysOff);
+    m_mainWidget->setFixedSize(m_scrollArea->viewport()->width(), rowHeight() * rowCount());
 }
 
 void GridWidget::start()
 {
-    const auto devList{AdbClient::getDeviceList(m_cellConf.host, m_cellConf.port)};
-    auto it{m_cellWidgets.begin()};
-    for (auto &devId : devList) {
-        (*it)->setDevice(devId);
-        it++;
-        if (it == m_cellWidgets.end()) {
+    // device lists come later, from the event loop
+    stopTrackers();
+    m_started = true;
+    for (const AdbServer &server : m_cellConf.servers) {
+        auto tracker = new DeviceTracker(this);
+        connect(tracker, &DeviceTracker::devicesChanged, this, [this, tracker]() {
+            onDevicesChanged(tracker);
+        });
+        connect(tracker, &DeviceTracker::stateChanged, this, &GridWidget::updateStatus);
+        m_trackers.push_back(tracker);
+        tracker->start(server);
+    }
+    updateStatus();
+}
+
+void GridWidget::stop()
+{
+    m_started = false;
+    stopTrackers();
+    closeDetails();
+    for (auto session : m_sessions) {
+        session->stop();
+    }
+}
+
+void GridWidget::saveReplay()
+{
+    for (auto session : m_sessions) {
+        session->saveReplay();
+    }
+}
+
+void GridWidget::updateStreams()
+{
+    if (!m_started || !m_scrollArea) {
+        return;
+    }
+    // capture pipelines only for what is on or near the screen
+    const int cols = qMax(1, m_cellConf.cols);
+    const int page = m_scrollArea->viewport()->height();
+    const int top = m_scrollArea->verticalScrollBar()->value();
+    const int height = rowHeight();
+    for (int i{}; i != int(m_sessions.size()); ++i) {
+        CellSession *session = m_sessions[i];
+        const int rowTop = i / cols * height;
+        const int rowBottom = rowTop + height;
+        const bool online = m_online.contains(deviceKey(session->server(), session->deviceId()));
+        if (rowBottom > top - streamAheadPages * page
+            && rowTop < top + (streamAheadPages + 1) * page && online) {
+            session->start();
+        } else if (!online) {
+            session->stop();
+        } else if ((rowBottom < top - streamKeepPages * page
+                    || rowTop > top + (streamKeepPages + 1) * page)
+                   && !session->needsStream()) {
+            // far away cells only keep streaming for their recording or replay buffer
+            session->stop();
+        }
+    }
+}
+
+void GridWidget::onDevicesChanged(DeviceTracker *tracker)
+{
+    if (!m_started) {
+        return;
+    }
+    const AdbServer server = tracker->server();
+    const QStringList devices = tracker->devices();
+    const QString prefix = deviceKey(server, QString());
+    QMutableSetIterator<QString> online(m_online);
+    while (online.hasNext()) {
+        if (online.next().startsWith(prefix)) {
+            online.remove();
+        }
+    }
+    for (const QString &deviceId : devices) {
+        m_online.insert(deviceKey(server, deviceId));
+    }
+
+    // a device keeps its cell while it is gone, new ones take the first free cells
+    QSet<QString> bound;
+    int freeCells = 0;
+    for (auto session : m_sessions) {
+        if (session->deviceId().isEmpty()) {
+            ++freeCells;
+        } else if (session->server() == server) {
+            bound.insert(session->deviceId());
+        }
+    }
+    QStringList added;
+    for (const QString &deviceId : devices) {
+        if (!bound.contains(deviceId)) {
+            added.append(deviceId);
+        }
+    }
+    if (added.size() > freeCells) {
+        setCellCount(int(m_sessions.size()) + added.size() - freeCells);
+    }
+    auto it = m_sessions.begin();
+    for (const QString &deviceId : added) {
+        while ((*it)->deviceId().size()) {
+            ++it;
+        }
+        (*it)->setDevice(server, deviceId);
+    }
+
+    updateStatus();
+    updateVisibility();
+    updateStreams();
+}
+
+void GridWidget::updateStatus()
+{
+    QStringList waiting;
+    int devices = 0;
+    for (const DeviceTracker *tracker : m_trackers) {
+        if (tracker->state() == DeviceTracker::Waiting) {
+            waiting.append(tracker->server().name());
+        }
+        devices += tracker->devices().size();
+    }
+    if (m_trackers.empty()) {
+        emit statusChanged(QString());
+    } else if (!waiting.isEmpty()) {
+        emit statusChanged(tr("Waiting for adb server at %1").arg(waiting.join(", ")));
+    } else {
+        emit statusChanged(tr("%n device(s) connected", "", devices));
+    }
+}
+
+void GridWidget::stopTrackers()
+{
+    for (auto tracker : m_trackers) {
+        tracker->disconnect(this);
+        tracker->stop();
+        tracker->deleteLater();
+    }
+    m_trackers.clear();
+    m_online.clear();
+    updateStatus();
+}
+
+QString GridWidget::deviceKey(const AdbServer &server, const QString &deviceId)
+{
+    return server.name() + '/' + deviceId;
+}
+
+void GridWidget::showEvent(QShowEvent *event)
+{
+    // minimizing and restoring is seen on the top level window
+    if (m_window != window()) {
+        if (m_window) {
+            m_window->removeEventFilter(this);
+        }
+        m_window = window();
+        m_window->installEventFilter(this);
+    }
+    QWidget::showEvent(event);
+    updateVisibility();
+}
+
+bool GridWidget::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == m_window) {
+        switch (event->type()) {
+        case QEvent::WindowStateChange:
+        case QEvent::Show:
+        case QEvent::Hide:
+            // resume right away, don't wait for the poll
+            QTimer::singleShot(0, this, &GridWidget::updateVisibility);
+            break;
+        default:
             break;
         }
+    } else if (m_scrollArea && watched == m_scrollArea->viewport()
+               && event->type() == QEvent::Resize) {
+        updateContentSize();
+        updateStreams();
     }
-    for (auto dw : m_cellWidgets) {
-        dw->start();
+    return QWidget::eventFilter(watched, event);
+}
+
+void GridWidget::updateVisibility()
+{
+    const bool hidden = !isVisible() || window()->isMinimized();
+    // platforms that know it report a window behind others as not exposed
+    const QWindow *handle = window()->windowHandle();
+    const bool exposed = handle && handle->isExposed();
+    const QRegion visible = hidden || !exposed || !m_mainWidget ? QRegion()
+                                                                : m_mainWidget->visibleRegion();
+    for (int i{}; i != int(m_sessions.size()); ++i) {
+        VideoSink::Visibility visibility = VideoSink::Hidden;
+        if (!hidden) {
+            // cells out of the viewport or under another widget
+            bool seen;
+            if (!exposed) {
+                seen = false;
+            } else if (m_surface) {
+                seen = visible.intersects(m_surface->cellRect(i));
+            } else {
+                seen = !m_cellWidgets[i]->visibleRegion().isEmpty();
+            }
+            visibility = seen ? VideoSink::Visible : VideoSink::Covered;
+        }
+        m_sessions[i]->setVisibility(visibility);
     }
 }
 
-void GridWidget::stop()
+void GridWidget::openDetail(CellSession *session)
+{
+    QPointer<DetailWindow> &detail = m_details[session];
+    if (!detail) {
+        detail = new DetailWindow(session->source(), this);
+        connect(detail, &QObject::destroyed, this, [this, session]() {
+            m_details.remove(session);
+            updateDetailState();
+        });
+        detail->show();
+        updateDetailState();
+    }
+    detail->raise();
+    detail->activateWindow();
+}
+
+void GridWidget::closeDetails()
+{
+    const auto details = m_details.values();
+    m_details.clear();
+    for (const QPointer<DetailWindow> &detail : details) {
+        if (detail) {
+            detail->disconnect(this);
+            delete detail;
+        }
+    }
+    updateDetailState();
+}
+
+void GridWidget::updateDetailState()
 {
-    for (auto dw : m_cellWidgets) {
-        dw->stop();
+    // the QoS manager moves the cells out of the detail window's way
+    for (auto session : m_sessions) {
+        session->setDetailOpen(m_details.contains(session));
     }
 }
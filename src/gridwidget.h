@@ -1,10 +1,23 @@
 #ifndef GRIDWIDGET_H
 #define GRIDWIDGET_H
+#include <QHash>
+#include <QPointer>
+#include <QSet>
+#include <QTimer>
 #include <QWidget>
-#include "cellwidget.h"
+#include "cellsession.h"
+#include "device/devicetracker.h"
 
 class QGridLayout;
+class QScrollArea;
+class CellWidget;
+class DetailWindow;
+class GridSurface;
 
+// A scrollable grid with a cell per device. Rows x cols cells fit the view,
+// more devices add rows below. Only cells in or near the view stream, the
+// others keep their last frame until they are scrolled back in. Devices are
+// followed as the adb servers report them, cells are bound as they appear.
 class GridWidget : public QWidget
 {
     Q_OBJECT
@@ -17,13 +30,48 @@ public:
     void free();
     void start();
     void stop();
+    void saveReplay();
+
+signals:
+    void statusChanged(const QString &message);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+    void showEvent(QShowEvent *event) override;
+
+private slots:
+    void openDetail(CellSession *session);
+    void updateVisibility();
+    void updateStreams();
+    void onDevicesChanged(DeviceTracker *tracker);
+    void updateStatus();
 
 private:
+    void setCellCount(int count);
+    int rowCount() const;
+    int rowHeight() const;
+    void updateContentSize();
+    void closeDetails();
+    void updateDetailState();
+    void stopTrackers();
+    static QString deviceKey(const AdbServer &server, const QString &deviceId);
+
     CellWidgetConf m_cellConf{};
+    bool m_started{};
+    // one per adb server, all enumerating at once
+    std::vector<DeviceTracker *> m_trackers{};
+    // devices the adb servers report ready by deviceKey(), cells of others don't stream
+    QSet<QString> m_online{};
 
+    QScrollArea *m_scrollArea{};
     QWidget *m_mainWidget{};
     QGridLayout *m_gridLayout{};
+    GridSurface *m_surface{};
+    std::vector<CellSession *> m_sessions{};
     std::vector<CellWidget *> m_cellWidgets{};
+    QHash<CellSession *, QPointer<DetailWindow>> m_details{};
+    QPointer<QWidget> m_window{};
+    QTimer m_visibilityTimer{};
 };
 
 #endif // SCROLLAREA_H
@@ -0,0 +1,79 @@
+#include "shellinput.h"
+#include <QKeyEvent>
+#include "device/adbclient.h"
+#include "input/input_to_adroid_keys.h"
+
+// a press that moves less than this is a tap, otherwise a swipe
+static const int tapDistance = 10;
+
+ShellInput::ShellInput(const StreamHub::Source &source, QObject *parent)
+    : QObject(parent)
+{
+    m_adb = new AdbClient();
+    m_adb->setHost(source.host, source.port);
+    m_adb->setDevice(source.deviceId);
+    m_adb->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_adb, &QObject::deleteLater);
+    AdbClient *adb = m_adb;
+    connect(this, &ShellInput::shellCommand, m_adb, [adb](const QByteArray &command) {
+        adb->shell(command.constData());
+    });
+    m_thread.start();
+}
+
+ShellInput::~ShellInput()
+{
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void ShellInput::press(const QPoint &pos)
+{
+    m_pressPos = pos;
+    m_pressTimer.start();
+}
+
+void ShellInput::release(const QPoint &pos, const QSize &viewSize, const QSize &frameSize)
+{
+    if (!m_pressTimer.isValid() || viewSize.isEmpty() || frameSize.isEmpty()) {
+        return;
+    }
+    // frames are in the current orientation, as are "input" coordinates
+    const auto toDevice = [&](const QPoint &p) {
+        return QPoint(p.x() * frameSize.width() / viewSize.width(),
+                      p.y() * frameSize.height() / viewSize.height());
+    };
+    const QPoint from = toDevice(m_pressPos);
+    const QPoint to = toDevice(pos);
+    if ((pos - m_pressPos).manhattanLength() < tapDistance) {
+        emit shellCommand(QString("input tap %1 %2").arg(from.x()).arg(from.y()).toLatin1());
+    } else {
+        emit shellCommand(QString("input swipe %1 %2 %3 %4 %5")
+                              .arg(from.x())
+                              .arg(from.y())
+                              .arg(to.x())
+                              .arg(to.y())
+                              .arg(qMax<qint64>(1, m_pressTimer.elapsed()))
+                              .toLatin1());
+    }
+    m_pressTimer.invalidate();
+}
+
+bool ShellInput::key(QKeyEvent *event)
+{
+    const QString text = event->text();
+    const auto key = qtToAndroidCode.find(Qt::Key(event->key()));
+    // "input text" can't do spaces, those go as key events as well
+    if (key != qtToAndroidCode.cend()
+        && (text.isEmpty() || !text.at(0).isPrint() || event->key() == Qt::Key_Space)) {
+        emit shellCommand(QByteArray("input keyevent ").append(QByteArray::number(key.value())));
+        return true;
+    }
+    if (!text.isEmpty() && text.at(0).isPrint()) {
+        QString quoted = text;
+        quoted.replace('\'', "'\\''");
+        emit shellCommand(QString("input text '%1'").arg(quoted).toUtf8());
+        return true;
+    }
+    return false;
+}
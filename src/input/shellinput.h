@@ -0,0 +1,37 @@
+#ifndef SHELLINPUT_H
+#define SHELLINPUT_H
+#include <QElapsedTimer>
+#include <QPoint>
+#include <QSize>
+#include <QThread>
+#include "device/streamhub.h"
+class AdbClient;
+class QKeyEvent;
+
+// Sends taps, swipes and keys to a device with "input" shell commands. The
+// commands run on a worker thread, so a slow device doesn't stall the GUI.
+// Positions are given in frame pixels of the given frame size.
+class ShellInput : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ShellInput(const StreamHub::Source &source, QObject *parent = nullptr);
+    ~ShellInput();
+
+    // mouse press and release of a tap or a swipe, pos in a view of viewSize
+    void press(const QPoint &pos);
+    void release(const QPoint &pos, const QSize &viewSize, const QSize &frameSize);
+    bool key(QKeyEvent *event);
+
+signals:
+    void shellCommand(const QByteArray &command);
+
+private:
+    QThread m_thread{};
+    AdbClient *m_adb{};
+    QPoint m_pressPos{};
+    QElapsedTimer m_pressTimer{};
+};
+
+#endif // SHELLINPUT_H
@@ -2,9 +2,19 @@
 #include <QDebug>
 #include <QLibraryInfo>
 #include <QMouseEvent>
+#include <QProgressBar>
 #include <QSettings>
+#include <QStatusBar>
 #include <QTimer>
+#include "device/bitratecontroller.h"
+#include "device/replaybuffer.h"
+#include "device/scrcpyvideothread.h"
+#include "device/startupscheduler.h"
+#include "device/streamserver.h"
+#include "displayclock.h"
 #include "gridwidget.h"
+#include "qosmanager.h"
+#include "thumbnailcache.h"
 #include "toolbar.h"
 #include "ui_mainwindow.h"
 
@@ -21,15 +31,67 @@ MainWindow::MainWindow(QWidget *parent)
 
     connect(m_toolbar, &Toolbar::start, this, &MainWindow::onStart);
     connect(m_toolbar, &Toolbar::stop, this, &MainWindow::onStop);
+    connect(m_toolbar, &Toolbar::saveReplay, this, &MainWindow::onSaveReplay);
+    connect(m_gridWidget, &GridWidget::statusChanged, statusBar(), [this](const QString &message) {
+        statusBar()->showMessage(message);
+    });
+
+    m_startupProgress = new QProgressBar();
+    m_startupProgress->setFormat(tr("Connecting %v of %m"));
+    m_startupProgress->setMaximumWidth(250);
+    m_startupProgress->hide();
+    statusBar()->addPermanentWidget(m_startupProgress);
+    connect(StartupScheduler::instance(),
+            &StartupScheduler::progressChanged,
+            this,
+            &MainWindow::onStartupProgress);
 
     QSettings settings("settings.ini", QSettings::IniFormat);
     m_toolbar->loadState(settings);
+    ReplayBuffer::setBudget(settings.value("replay/budgetMB", 512).toLongLong() * 1024 * 1024);
+    // what the devices of one adb server may stream together, e.g. the throughput of its USB hub
+    BitrateController::instance()->setBudget(
+        settings.value("bitrate/budgetMbps", 32).toLongLong() * 1000 * 1000);
+    ScrcpyVideoThread::setServer(settings.value("scrcpy/server").toString(),
+                                 settings.value("scrcpy/version", ScrcpyVideoThread::serverVersion())
+                                     .toString());
+    // host:port of a stand-in server, e.g. one replaying a canned H.264 file
+    ScrcpyVideoThread::setDefaultEndpoint(settings.value("scrcpy/endpoint").toString());
+    // streams connecting at once per adb server, it runs their shells one after the other
+    StartupScheduler::instance()->setMaxConcurrent(settings.value("startup/maxConcurrent", 4).toInt());
+    // repaints per second, 0 follows the screen
+    DisplayClock::instance()->setRate(settings.value("display/refreshHz", 0).toDouble());
+    QosManager *qos = QosManager::instance();
+    QosManager::Profile focused = qos->profile(QosManager::TierFocused);
+    focused.minRate = settings.value("qos/focusedRate", focused.minRate).toDouble();
+    qos->setProfile(QosManager::TierFocused, focused);
+    QosManager::Profile idle = qos->profile(QosManager::TierIdle);
+    idle.scale = settings.value("qos/idleScale", idle.scale * 100).toDouble() / 100;
+    qos->setProfile(QosManager::TierIdle, idle);
+    qos->setRecentSeconds(settings.value("qos/recentSeconds", qos->recentSeconds()).toInt());
+    // port viewers on the network watch device streams on, 0 is off
+    m_serverPort = settings.value("server/port", 0).toInt();
+    if (!StreamServer::instance()->listen(m_serverPort)) {
+        statusBar()->showMessage(tr("Can't serve streams on port %1").arg(m_serverPort));
+    }
+    // last frames shown while a new grid connects, empty is the user's cache directory
+    ThumbnailCache::instance()->open(settings.value("cache/thumbnails").toString());
 }
 
 MainWindow::~MainWindow()
 {
     QSettings settings("settings.ini", QSettings::IniFormat);
     m_toolbar->saveState(settings);
+    settings.setValue("replay/budgetMB", ReplayBuffer::budget() / 1024 / 1024);
+    settings.setValue("bitrate/budgetMbps", BitrateController::instance()->budget() / 1000 / 1000);
+    settings.setValue("scrcpy/version", ScrcpyVideoThread::serverVersion());
+    settings.setValue("startup/maxConcurrent", StartupScheduler::instance()->maxConcurrent());
+    settings.setValue("display/refreshHz", DisplayClock::instance()->rate());
+    QosManager *qos = QosManager::instance();
+    settings.setValue("qos/focusedRate", qos->profile(QosManager::TierFocused).minRate);
+    settings.setValue("qos/idleScale", qos->profile(QosManager::TierIdle).scale * 100);
+    settings.setValue("qos/recentSeconds", qos->recentSeconds());
+    settings.setValue("server/port", m_serverPort);
     delete ui;
 }
 
@@ -44,3 +106,15 @@ void MainWindow::onStop()
 {
     m_gridWidget->stop();
 }
+
+void MainWindow::onSaveReplay()
+{
+    m_gridWidget->saveReplay();
+}
+
+void MainWindow::onStartupProgress(int connected, int total)
+{
+    m_startupProgress->setVisible(connected < total);
+    m_startupProgress->setMaximum(total);
+    m_startupProgress->setValue(connected);
+}
@@ -7,6 +7,7 @@ class MainWindow;
 }
 class GridWidget;
 class Toolbar;
+class QProgressBar;
 
 class MainWindow : public QMainWindow
 {
@@ -19,11 +20,16 @@ public:
 private slots:
     void onStart();
     void onStop();
+    void onSaveReplay();
+    void onStartupProgress(int connected, int total);
 
 private:
     Ui::MainWindow *ui{};
     Toolbar *m_toolbar{};
     GridWidget *m_gridWidget{};
+    QProgressBar *m_startupProgress{};
+    // as configured, a port that was busy at launch is tried again next time
+    int m_serverPort{};
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,94 @@
+#include "qosmanager.h"
+#include "cellsession.h"
+
+// how often recently used cells are checked for having gone idle
+static const int updateIntervalMs = 1000;
+
+QosManager::QosManager(QObject *parent)
+    : QObject(parent)
+{
+    m_profiles[TierFocused].minRate = 30;
+    m_profiles[TierFocused].weight = 8;
+    m_profiles[TierRecent].weight = 2;
+    m_profiles[TierIdle].scale = 0.5;
+    m_profiles[TierIdle].decodeMode = VideoThread::DecodeThumbnail;
+    m_profiles[TierBackground].scale = 0.5;
+    m_profiles[TierBackground].maxRate = 1;
+    m_profiles[TierBackground].decodeMode = VideoThread::DecodeThumbnail;
+
+    connect(&m_timer, &QTimer::timeout, this, &QosManager::update);
+}
+
+QosManager *QosManager::instance()
+{
+    static QosManager manager;
+    return &manager;
+}
+
+void QosManager::setProfile(Tier tier, const Profile &profile)
+{
+    m_profiles[tier] = profile;
+    update();
+}
+
+QosManager::Profile QosManager::profile(Tier tier) const
+{
+    return m_profiles[tier];
+}
+
+void QosManager::setRecentSeconds(int seconds)
+{
+    m_recentSeconds = seconds;
+    update();
+}
+
+int QosManager::recentSeconds() const
+{
+    return m_recentSeconds;
+}
+
+void QosManager::addSession(CellSession *session)
+{
+    m_sessions.append(session);
+}
+
+void QosManager::removeSession(CellSession *session)
+{
+    m_sessions.removeAll(session);
+}
+
+QosManager::Tier QosManager::tierOf(const CellSession *session, bool detailOpen) const
+{
+    if (session->isDetailOpen()) {
+        return TierBackground;
+    }
+    if (session->isFocused()) {
+        return TierFocused;
+    }
+    if (!detailOpen && session->idleMs() < qint64(m_recentSeconds) * 1000) {
+        return TierRecent;
+    }
+    return TierIdle;
+}
+
+void QosManager::update()
+{
+    bool detailOpen = false;
+    for (const CellSession *session : m_sessions) {
+        detailOpen = detailOpen || session->isDetailOpen();
+    }
+
+    bool recent = false;
+    for (CellSession *session : m_sessions) {
+        const Tier tier = tierOf(session, detailOpen);
+        recent = recent || tier == TierRecent;
+        session->setTier(tier);
+    }
+
+    // only recent cells go idle by time alone
+    if (recent && !m_timer.isActive()) {
+        m_timer.start(updateIntervalMs);
+    } else if (!recent) {
+        m_timer.stop();
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef QOSMANAGER_H
+#define QOSMANAGER_H
+#include <QList>
+#include <QObject>
+#include <QTimer>
+#include "device/videothread.h"
+class CellSession;
+
+// Decides how much of the host every cell gets. The cell under the mouse is
+// focused and gets a high rate and decode priority, cells interacted with a
+// moment ago keep their full settings, the rest are idle and converted at a
+// lower resolution. A cell open in a detail window only shows a background
+// view, and while any detail window is open no cell counts as recent.
+class QosManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Tier { TierFocused, TierRecent, TierIdle, TierBackground };
+
+    struct Profile
+    {
+        // of the cell's own scale or size
+        double scale{1.0};
+        // bounds for the cell's image rate, 0 leaves it open
+        double minRate{};
+        double maxRate{};
+        // at least this much is skipped, a cell may ask to skip more
+        VideoThread::DecodeMode decodeMode{VideoThread::DecodeFull};
+        int weight{1};
+    };
+
+    static QosManager *instance();
+
+    void setProfile(Tier tier, const Profile &profile);
+    Profile profile(Tier tier) const;
+    void setRecentSeconds(int seconds);
+    int recentSeconds() const;
+
+    void addSession(CellSession *session);
+    void removeSession(CellSession *session);
+
+public slots:
+    // assigns tiers to all sessions again
+    void update();
+
+private:
+    explicit QosManager(QObject *parent = nullptr);
+
+    Tier tierOf(const CellSession *session, bool detailOpen) const;
+
+    Profile m_profiles[TierBackground + 1]{};
+    int m_recentSeconds{10};
+    QList<CellSession *> m_sessions{};
+    QTimer m_timer{};
+};
+
+#endif // QOSMANAGER_H
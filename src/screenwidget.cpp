@@ -0,0 +1,57 @@
+#include "screenwidget.h"
+#include <QPainter>
+#include <QPaintEvent>
+
+ScreenWidget::ScreenWidget(QWidget *parent)
+    : QWidget(parent)
+{
+    // every pixel is painted by the frame, nothing behind needs repainting
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setAttribute(Qt::WA_NoSystemBackground);
+}
+
+ScreenWidget::~ScreenWidget() {}
+
+void ScreenWidget::setImage(const QImage &image, qreal devicePixelRatio)
+{
+    // keep the frame shared with the producer, setting its pixel ratio would detach it
+    m_image = image;
+    const QSize size = image.size() / devicePixelRatio;
+    if (size != m_size) {
+        m_size = size;
+        setFixedSize(m_size);
+    }
+    update();
+}
+
+const QImage &ScreenWidget::image() const
+{
+    return m_image;
+}
+
+void ScreenWidget::setStale(bool stale)
+{
+    if (m_stale != stale) {
+        m_stale = stale;
+        update();
+    }
+}
+
+QSize ScreenWidget::sizeHint() const
+{
+    return m_size;
+}
+
+void ScreenWidget::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+    if (m_image.isNull()) {
+        painter.fillRect(event->rect(), palette().window());
+        return;
+    }
+    // a 1:1 target on the backing store is a plain blit
+    painter.drawImage(rect(), m_image);
+    if (m_stale) {
+        painter.fillRect(rect(), QColor(0, 0, 0, 128));
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef SCREENWIDGET_H
+#define SCREENWIDGET_H
+#include <QImage>
+#include <QWidget>
+
+// Paints the latest frame as it is, the widget takes the frame's size and
+// only a different frame size causes a relayout.
+class ScreenWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit ScreenWidget(QWidget *parent = nullptr);
+    ~ScreenWidget();
+
+    // frames in device pixels are shown with the widget's pixel ratio
+    void setImage(const QImage &image, qreal devicePixelRatio = 1.0);
+    const QImage &image() const;
+    // dims the frame, it isn't live
+    void setStale(bool stale);
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    QImage m_image{};
+    QSize m_size{};
+    bool m_stale{};
+};
+
+#endif // SCREENWIDGET_H
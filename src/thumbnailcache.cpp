@@ -0,0 +1,242 @@
+#include "thumbnailcache.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include <cstring>
+#include <limits>
+
+// thumbnails fit in a square of this side, a rack's worth of devices fits the file
+static const quint32 maxSide = 160;
+static const quint32 slotCount = 256;
+static const quint32 cacheVersion = 2;
+
+struct ThumbnailFileHeader
+{
+    char magic[4];
+    quint32 version;
+    quint32 slotCount;
+    quint32 maxSide;
+};
+
+// followed by the pixels, RGB32 without padding
+struct ThumbnailSlot
+{
+    // "host:port/device id", serials repeat across adb servers
+    char device[128];
+    qint64 time;
+    quint32 frameWidth;
+    quint32 frameHeight;
+    quint32 width;
+    quint32 height;
+};
+
+static const qint64 slotSize = sizeof(ThumbnailSlot) + qint64(maxSide) * maxSide * 4;
+
+// ids longer than a slot holds are cut the same way when storing and looking up
+static QString slotKey(const QString &device)
+{
+    return device.left(int(sizeof(ThumbnailSlot::device)) - 1);
+}
+
+static QString slotKey(const ThumbnailSlot *slot)
+{
+    const uint length = qstrnlen(slot->device, sizeof(slot->device));
+    return QString::fromLatin1(slot->device, int(length));
+}
+
+ThumbnailCache::ThumbnailCache(QObject *parent)
+    : QObject(parent)
+{
+    m_writer = new QObject();
+    m_writer->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_writer, &QObject::deleteLater);
+    connect(this,
+            &ThumbnailCache::storeRequested,
+            m_writer,
+            [this](const QString &device, const QImage &image, const QSize &frameSize) {
+                write(device, image, frameSize);
+            });
+    m_thread.start(QThread::LowPriority);
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+    m_thread.quit();
+    m_thread.wait();
+    close();
+}
+
+ThumbnailCache *ThumbnailCache::instance()
+{
+    static ThumbnailCache cache;
+    return &cache;
+}
+
+bool ThumbnailCache::open(const QString &fileName)
+{
+    close();
+
+    QString path = fileName;
+    if (path.isEmpty()) {
+        const QString dir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                            + "/divvydroid";
+        QDir().mkpath(dir);
+        path = dir + "/thumbnails.cache";
+    }
+
+    QMutexLocker lock(&m_mutex);
+    m_file = new QFile(path);
+    if (!m_file->open(QIODevice::ReadWrite)) {
+        qWarning() << "WARNING: can't open thumbnail cache" << path;
+        delete m_file;
+        m_file = nullptr;
+        return false;
+    }
+
+    const qint64 size = sizeof(ThumbnailFileHeader) + slotCount * slotSize;
+    ThumbnailFileHeader header;
+    const bool valid = m_file->size() == size
+                       && m_file->read(reinterpret_cast<char *>(&header), sizeof(header))
+                              == sizeof(header)
+                       && std::memcmp(header.magic, "DDTC", 4) == 0
+                       && header.version == cacheVersion && header.slotCount == slotCount
+                       && header.maxSide == maxSide;
+    if (!valid) {
+        // new, or made with other slot sizes, start empty
+        if (!m_file->resize(0) || !m_file->resize(size)) {
+            qWarning() << "WARNING: can't create thumbnail cache" << path;
+            delete m_file;
+            m_file = nullptr;
+            return false;
+        }
+        std::memcpy(header.magic, "DDTC", 4);
+        header.version = cacheVersion;
+        header.slotCount = slotCount;
+        header.maxSide = maxSide;
+        m_file->seek(0);
+        m_file->write(reinterpret_cast<const char *>(&header), sizeof(header));
+        m_file->flush();
+    }
+
+    m_map = m_file->map(0, size);
+    if (!m_map) {
+        qWarning() << "WARNING: can't map thumbnail cache" << path;
+        delete m_file;
+        m_file = nullptr;
+        return false;
+    }
+
+    for (int i = 0; i != int(slotCount); ++i) {
+        const ThumbnailSlot *s = slot(i);
+        if (s->device[0]) {
+            m_index.insert(slotKey(s), i);
+        }
+    }
+    return true;
+}
+
+void ThumbnailCache::close()
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_file) {
+        m_file->unmap(m_map);
+        delete m_file;
+    }
+    m_file = nullptr;
+    m_map = nullptr;
+    m_index.clear();
+}
+
+ThumbnailSlot *ThumbnailCache::slot(int index) const
+{
+    uchar *data = m_map + sizeof(ThumbnailFileHeader) + index * slotSize;
+    return reinterpret_cast<ThumbnailSlot *>(data);
+}
+
+QImage ThumbnailCache::load(const QString &device, QSize *frameSize, qint64 *ageMs) const
+{
+    QMutexLocker lock(&m_mutex);
+    const int index = m_index.value(slotKey(device), -1);
+    if (!m_map || index < 0) {
+        return QImage();
+    }
+    const ThumbnailSlot *s = slot(index);
+    if (!s->width || !s->height || s->width > maxSide || s->height > maxSide) {
+        return QImage();
+    }
+    if (frameSize) {
+        *frameSize = QSize(int(s->frameWidth), int(s->frameHeight));
+    }
+    if (ageMs) {
+        *ageMs = qMax<qint64>(0, QDateTime::currentMSecsSinceEpoch() - s->time);
+    }
+    // the writer may reuse the slot any time, take a copy
+    const uchar *pixels = reinterpret_cast<const uchar *>(s + 1);
+    const int width = int(s->width);
+    return QImage(pixels, width, int(s->height), width * 4, QImage::Format_RGB32).copy();
+}
+
+void ThumbnailCache::store(const QString &device, const QImage &image, const QSize &frameSize)
+{
+    if (!device.isEmpty() && !image.isNull()) {
+        emit storeRequested(device, image, frameSize);
+    }
+}
+
+int ThumbnailCache::slotFor(const QString &key)
+{
+    int index = m_index.value(key, -1);
+    if (index >= 0) {
+        return index;
+    }
+    // an empty slot, or the one of the device not seen the longest
+    qint64 oldest = std::numeric_limits<qint64>::max();
+    for (int i = 0; i != int(slotCount); ++i) {
+        const ThumbnailSlot *s = slot(i);
+        if (!s->device[0]) {
+            index = i;
+            break;
+        }
+        if (s->time < oldest) {
+            oldest = s->time;
+            index = i;
+        }
+    }
+    m_index.remove(slotKey(slot(index)));
+    m_index.insert(key, index);
+    return index;
+}
+
+void ThumbnailCache::write(const QString &device, const QImage &image, const QSize &frameSize)
+{
+    // scaled here, not on the GUI thread
+    const QImage thumb = image
+                             .scaled(maxSide,
+                                     maxSide,
+                                     Qt::KeepAspectRatio,
+                                     Qt::SmoothTransformation)
+                             .convertToFormat(QImage::Format_RGB32);
+    const QString key = slotKey(device);
+    const QByteArray id = key.toLatin1();
+
+    QMutexLocker lock(&m_mutex);
+    if (!m_map) {
+        return;
+    }
+    ThumbnailSlot *s = slot(slotFor(key));
+    std::memset(s->device, 0, sizeof(s->device));
+    std::memcpy(s->device, id.constData(), size_t(id.size()));
+    s->time = QDateTime::currentMSecsSinceEpoch();
+    s->frameWidth = quint32(frameSize.width());
+    s->frameHeight = quint32(frameSize.height());
+    s->width = quint32(thumb.width());
+    s->height = quint32(thumb.height());
+    uchar *pixels = reinterpret_cast<uchar *>(s + 1);
+    const size_t rowBytes = size_t(thumb.width()) * 4;
+    for (int y = 0; y != thumb.height(); ++y) {
+        std::memcpy(pixels + y * rowBytes, thumb.constScanLine(y), rowBytes);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QThread>
+
+class QFile;
+struct ThumbnailSlot;
+
+// Last frame of every device as a small thumbnail, in a memory mapped file
+// of fixed size slots, so a new grid shows something right away. Loading is
+// a copy out of the map, scaling and writing happen on the cache's thread.
+class ThumbnailCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ThumbnailCache *instance();
+
+    // an empty name uses the user's cache directory
+    bool open(const QString &fileName = QString());
+    void close();
+
+    // devices are "<adb host>:<adb port>/<device id>"; frameSize is set to
+    // the full size of the device frame the thumbnail shows, ageMs to how
+    // long ago it was stored
+    QImage load(const QString &device, QSize *frameSize = nullptr, qint64 *ageMs = nullptr) const;
+    void store(const QString &device, const QImage &image, const QSize &frameSize);
+
+signals:
+    void storeRequested(const QString &device, const QImage &image, const QSize &frameSize);
+
+private:
+    explicit ThumbnailCache(QObject *parent = nullptr);
+    ~ThumbnailCache();
+
+    void write(const QString &device, const QImage &image, const QSize &frameSize);
+    ThumbnailSlot *slot(int index) const;
+    int slotFor(const QString &key);
+
+    mutable QMutex m_mutex{};
+    QFile *m_file{};
+    uchar *m_map{};
+    QHash<QString, int> m_index{};
+
+    QThread m_thread{};
+    QObject *m_writer{};
+};
+
+#endif // THUMBNAILCACHE_H
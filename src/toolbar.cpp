@@ -1,5 +1,6 @@
 #include "toolbar.h"
 #include <QCheckBox>
+#include <QComboBox>
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QLineEdit>
@@ -19,25 +20,35 @@ Toolbar::Toolbar(QWidget *parent)
     m_portInp = new QSpinBox();
     m_scaleInp = new QSpinBox();
     m_rateInp = new QSpinBox();
-    m_fastInp = new QCheckBox("Fast");
+    m_backendInp = new QComboBox();
+    m_fitInp = new QCheckBox("Fit");
+    m_filterInp = new QComboBox();
+    m_surfaceInp = new QCheckBox("Surface");
+    m_recordFormatInp = new QComboBox();
+    m_replayInp = new QSpinBox();
+    m_saveReplayBtn = new QPushButton("Save replay");
 
     m_rowsInp->setFixedSize(60, 30);
     m_rowsInp->setMinimum(1);
-    m_rowsInp->setMaximum(9);
+    // rows in view, more devices are scrolled to
+    m_rowsInp->setMaximum(32);
     m_rowsInp->setValue(2);
 
     m_colsInp->setFixedSize(60, 30);
     m_colsInp->setMinimum(1);
-    m_colsInp->setMaximum(9);
+    m_colsInp->setMaximum(32);
     m_colsInp->setValue(4);
 
     m_hostInp->setText("127.0.0.1");
-    m_hostInp->setFixedSize(150, 30);
+    m_hostInp->setFixedSize(200, 30);
+    m_hostInp->setToolTip("adb servers as host or host:port, comma separated, "
+                          "devices of all share the grid");
 
     m_portInp->setMinimum(1);
     m_portInp->setMaximum(65535);
     m_portInp->setValue(5037);
     m_portInp->setFixedSize(60, 30);
+    m_portInp->setToolTip("Port of hosts given without one");
 
     m_scaleInp->setMinimum(1);
     m_scaleInp->setMaximum(999);
@@ -46,9 +57,40 @@ Toolbar::Toolbar(QWidget *parent)
     m_scaleInp->setValue(100);
     m_scaleInp->setFixedSize(60, 30);
 
+    m_fitInp->setToolTip("Scale frames to the cell size instead of by Scale");
+    connect(m_fitInp, &QCheckBox::toggled, m_scaleInp, &QSpinBox::setDisabled);
+
+    // same order as VideoThread::ScaleFilter
+    m_filterInp->addItem("Auto");
+    m_filterInp->addItem("Fast");
+    m_filterInp->addItem("Area");
+    m_filterInp->addItem("Bicubic");
+    m_filterInp->setToolTip("Scaling filter, Auto picks a cheaper one for small cells");
+    m_filterInp->setFixedSize(80, 30);
+
+    m_surfaceInp->setToolTip("Draw all cells on one surface, for large grids");
+
     m_rateInp->setMinimum(1);
     m_rateInp->setMaximum(999);
 
+    // same order as StreamHub::Backend
+    m_backendInp->addItem("screencap");
+    m_backendInp->addItem("screenrecord");
+    m_backendInp->addItem("scrcpy");
+    m_backendInp->setToolTip("screencap grabs stills, screenrecord and scrcpy stream H.264");
+    m_backendInp->setFixedSize(110, 30);
+
+    m_recordFormatInp->addItem("mp4");
+    m_recordFormatInp->addItem("mkv");
+    m_recordFormatInp->setFixedSize(60, 30);
+
+    m_replayInp->setMinimum(0);
+    m_replayInp->setMaximum(600);
+    m_replayInp->setSuffix("s");
+    m_replayInp->setSpecialValueText("Off");
+    m_replayInp->setValue(30);
+    m_replayInp->setFixedSize(60, 30);
+
     addWidget(m_startBtn);
     addWidget(m_stopBtn);
     // Host Port
@@ -63,16 +105,28 @@ Toolbar::Toolbar(QWidget *parent)
     addWidget(m_rowsInp);
     addWidget(new QLabel("Cols"));
     addWidget(m_colsInp);
-    // Scale Rate Fast
+    // Scale Rate Backend
     addSeparator();
     addWidget(new QLabel("Scale"));
     addWidget(m_scaleInp);
+    addWidget(m_fitInp);
+    addWidget(new QLabel("Filter"));
+    addWidget(m_filterInp);
     addWidget(new QLabel("Rate"));
     addWidget(m_rateInp);
-    addWidget(m_fastInp);
+    addWidget(m_backendInp);
+    addWidget(m_surfaceInp);
+    // Recording
+    addSeparator();
+    addWidget(new QLabel("Record"));
+    addWidget(m_recordFormatInp);
+    addWidget(new QLabel("Replay"));
+    addWidget(m_replayInp);
+    addWidget(m_saveReplayBtn);
 
     connect(m_startBtn, &QPushButton::clicked, this, &Toolbar::start);
     connect(m_stopBtn, &QPushButton::clicked, this, &Toolbar::stop);
+    connect(m_saveReplayBtn, &QPushButton::clicked, this, &Toolbar::saveReplay);
 }
 
 Toolbar::~Toolbar() {}
@@ -107,21 +161,50 @@ int Toolbar::rate() const
     return m_rateInp->value();
 }
 
-bool Toolbar::fast() const
+StreamHub::Backend Toolbar::backend() const
+{
+    return StreamHub::Backend(m_backendInp->currentIndex());
+}
+
+bool Toolbar::fit() const
+{
+    return m_fitInp->isChecked();
+}
+
+int Toolbar::scaleFilter() const
+{
+    return m_filterInp->currentIndex();
+}
+
+bool Toolbar::surface() const
+{
+    return m_surfaceInp->isChecked();
+}
+
+QString Toolbar::recordFormat() const
+{
+    return m_recordFormatInp->currentText();
+}
+
+int Toolbar::replaySeconds() const
 {
-    return m_fastInp->isChecked();
+    return m_replayInp->value();
 }
 
 CellWidgetConf Toolbar::cellConf() const
 {
     CellWidgetConf conf;
-    conf.host = host();
-    conf.port = port();
+    conf.servers = AdbServer::parseList(host(), port());
     conf.rows = rows();
     conf.cols = cols();
     conf.scale = scale();
     conf.rate = rate();
-    conf.fast = fast();
+    conf.backend = backend();
+    conf.fit = fit();
+    conf.scaleFilter = scaleFilter();
+    conf.surface = surface();
+    conf.recordFormat = recordFormat();
+    conf.replaySeconds = replaySeconds();
     return conf;
 }
 
@@ -133,7 +216,12 @@ void Toolbar::saveState(QSettings &settings) const
     settings.setValue("toolbar/cols", cols());
     settings.setValue("toolbar/scale", scale());
     settings.setValue("toolbar/rate", rate());
-    settings.setValue("toolbar/fast", fast());
+    settings.setValue("toolbar/backend", int(backend()));
+    settings.setValue("toolbar/fit", fit());
+    settings.setValue("toolbar/scaleFilter", scaleFilter());
+    settings.setValue("toolbar/surface", surface());
+    settings.setValue("toolbar/recordFormat", recordFormat());
+    settings.setValue("toolbar/replay", replaySeconds());
 }
 
 void Toolbar::loadState(const QSettings &settings)
@@ -144,5 +232,14 @@ void Toolbar::loadState(const QSettings &settings)
     m_colsInp->setValue(settings.value("toolbar/cols", 4).toInt());
     m_scaleInp->setValue(settings.value("toolbar/scale", 1).toInt());
     m_rateInp->setValue(settings.value("toolbar/rate", 1).toInt());
-    m_fastInp->setChecked(settings.value("toolbar/fast", false).toBool());
+    // older settings only knew the Fast checkbox for screenrecord
+    const int backend = settings.value("toolbar/fast", false).toBool()
+                            ? StreamHub::BackendScreenrecord
+                            : StreamHub::BackendScreencap;
+    m_backendInp->setCurrentIndex(settings.value("toolbar/backend", backend).toInt());
+    m_fitInp->setChecked(settings.value("toolbar/fit", false).toBool());
+    m_filterInp->setCurrentIndex(settings.value("toolbar/scaleFilter", 0).toInt());
+    m_surfaceInp->setChecked(settings.value("toolbar/surface", false).toBool());
+    m_recordFormatInp->setCurrentText(settings.value("toolbar/recordFormat", "mp4").toString());
+    m_replayInp->setValue(settings.value("toolbar/replay", 30).toInt());
 }
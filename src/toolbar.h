@@ -1,13 +1,14 @@
 #ifndef TOOLBAR_H
 #define TOOLBAR_H
 #include <QToolBar>
-#include "cellwidget.h"
+#include "cellsession.h"
 
 class QPushButton;
 class QSpinBox;
 class QLabel;
 class QLineEdit;
 class QCheckBox;
+class QComboBox;
 class QSettings;
 
 class Toolbar : public QToolBar
@@ -17,6 +18,7 @@ class Toolbar : public QToolBar
 signals:
     void start();
     void stop();
+    void saveReplay();
 
 public:
     Toolbar(QWidget *parent = nullptr);
@@ -28,7 +30,12 @@ public:
     int cols() const;
     int scale() const;
     int rate() const;
-    bool fast() const;
+    StreamHub::Backend backend() const;
+    bool fit() const;
+    int scaleFilter() const;
+    bool surface() const;
+    QString recordFormat() const;
+    int replaySeconds() const;
 
     CellWidgetConf cellConf() const;
 
@@ -44,7 +51,13 @@ private:
     QSpinBox *m_colsInp{};
     QSpinBox *m_scaleInp{};
     QSpinBox *m_rateInp{};
-    QCheckBox *m_fastInp{};
+    QComboBox *m_backendInp{};
+    QCheckBox *m_fitInp{};
+    QComboBox *m_filterInp{};
+    QCheckBox *m_surfaceInp{};
+    QComboBox *m_recordFormatInp{};
+    QSpinBox *m_replayInp{};
+    QPushButton *m_saveReplayBtn{};
 };
 
 #endif // TOOLBAR_H
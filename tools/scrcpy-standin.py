@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""Serves a canned H.264 file the way a scrcpy server streams a device.
+
+DivvyDroid's scrcpy backend connects to it instead of starting a server on a
+device when settings.ini has scrcpy/endpoint=host:port. Every connection gets
+its own copy of the stream, looped forever and paced to the given frame rate:
+dummy byte, 64 byte device name, codec meta ("h264", width, height), then
+packets with 12 byte headers (PTS and config/keyframe flags, size).
+
+The input is a raw Annex-B H.264 stream, for example
+    adb exec-out screenrecord --output-format=h264 - > screen.h264
+    ffmpeg -i video.mp4 -c:v libx264 -bsf:v h264_mp4toannexb -f h264 screen.h264
+"""
+
+import argparse
+import socketserver
+import struct
+import time
+
+PACKET_FLAG_CONFIG = 1 << 63
+PACKET_FLAG_KEY = 1 << 62
+
+NAL_IDR = 5
+NAL_SPS = 7
+NAL_PPS = 8
+NAL_AUD = 9
+
+
+def split_nals(data):
+    """Yields every NAL unit of an Annex-B stream with its start code."""
+    starts = []
+    i = data.find(b'\x00\x00\x01')
+    while i >= 0:
+        # a 4 byte start code belongs to the NAL, not to the one before it
+        starts.append(i - 1 if i > 0 and data[i - 1] == 0 else i)
+        i = data.find(b'\x00\x00\x01', i + 3)
+    for begin, end in zip(starts, starts[1:] + [len(data)]):
+        yield data[begin:end]
+
+
+def nal_type(nal):
+    header = nal.index(b'\x00\x00\x01') + 3
+    return nal[header] & 0x1f, nal[header + 1:header + 2]
+
+
+def split_frames(data):
+    """Groups NAL units into (config, frame, keyframe) tuples.
+
+    Parameter sets become a config packet sent before the frame that follows
+    them, like the encoder does when it starts or restarts.
+    """
+    frames = []
+    config = b''
+    frame = b''
+    key = False
+    # parameter sets and SEI seen since the last slice, they start the next picture
+    pending_config = b''
+    pending = b''
+    for nal in split_nals(data):
+        kind, payload = nal_type(nal)
+        if kind in (1, NAL_IDR):
+            # first_mb_in_slice == 0, the first slice of a new picture
+            if frame and payload and payload[0] & 0x80:
+                frames.append((config, frame, key))
+                frame = b''
+                key = False
+            if not frame:
+                config, pending_config = pending_config, b''
+            frame += pending + nal
+            pending = b''
+            key = key or kind == NAL_IDR
+        elif kind in (NAL_SPS, NAL_PPS):
+            pending_config += nal
+        elif kind != NAL_AUD:
+            pending += nal
+    if frame:
+        frames.append((config, frame, key))
+    return frames
+
+
+class StandInHandler(socketserver.BaseRequestHandler):
+    def send_packet(self, flags, data):
+        self.request.sendall(struct.pack('>QI', flags, len(data)) + data)
+
+    def handle(self):
+        opts = self.server.opts
+        frames = self.server.frames
+        print('streaming to', self.client_address[0], self.client_address[1])
+        name = opts.name.encode()[:63].ljust(64, b'\x00')
+        try:
+            self.request.sendall(b'\x00' + name
+                                 + struct.pack('>4sII', b'h264', opts.width, opts.height))
+            interval = 1.0 / opts.fps
+            start = time.monotonic()
+            count = 0
+            while True:
+                for config, frame, key in frames:
+                    pts = int(count * interval * 1000000)
+                    if config:
+                        self.send_packet(PACKET_FLAG_CONFIG, config)
+                    self.send_packet(pts | (PACKET_FLAG_KEY if key else 0), frame)
+                    count += 1
+                    delay = start + count * interval - time.monotonic()
+                    if delay > 0:
+                        time.sleep(delay)
+        except (BrokenPipeError, ConnectionResetError):
+            print('disconnected', self.client_address[0], self.client_address[1])
+
+
+class StandInServer(socketserver.ThreadingTCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('file', help='raw Annex-B H.264 stream')
+    parser.add_argument('--host', default='127.0.0.1', help='address to listen on')
+    parser.add_argument('--port', type=int, default=27183, help='port to listen on')
+    parser.add_argument('--fps', type=float, default=30, help='frames per second')
+    parser.add_argument('--size', default='720x1280', help='WIDTHxHEIGHT sent as codec meta')
+    parser.add_argument('--name', default='scrcpy stand-in', help='device name')
+    opts = parser.parse_args()
+    opts.width, opts.height = (int(v) for v in opts.size.split('x'))
+
+    with open(opts.file, 'rb') as f:
+        frames = split_frames(f.read())
+    if not frames or not frames[0][0] or not frames[0][2]:
+        parser.error('%s must start with SPS, PPS and a keyframe' % opts.file)
+    print('%d frames, %d keyframes, listening on %s:%d'
+          % (len(frames), sum(1 for f in frames if f[2]), opts.host, opts.port))
+
+    server = StandInServer((opts.host, opts.port), StandInHandler)
+    server.opts = opts
+    server.frames = frames
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()